@@ -0,0 +1,263 @@
+//
+// devscale.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Device scaling benchmark: creates, reads and deletes 1k, 5k and 10k devices (or the
+// counts given on the command line) through the driver's IDL callbacks and reports the
+// memory the devices take and how long the callbacks take to complete.  The IDL result
+// functions are provided here, so the driver's answers come back to the benchmark
+// instead of the IDL.  Build with "make bench", ETI is left out so no broker is needed.
+//
+
+#include <vector>
+#include <algorithm>
+
+#include "common.h"
+#include "example.h"
+#include "idiexec.h"
+
+#define BENCH_CONF              "/tmp/devscale-idl.conf"
+#define BENCH_DPS_PER_DEV       8
+#define BENCH_MAX_COUNTS        8
+
+typedef struct {
+    IdlDev dev;
+    IdlInterfaceBlock ifblock;
+    IdlIapDatapoint iapdps[BENCH_DPS_PER_DEV];
+    IdlDatapoint dps[BENCH_DPS_PER_DEV];
+    char unid[sizeof("4294967295")];
+    char handle[sizeof("bench.4294967295")];
+} T_BenchDev;
+
+static std::vector<uint64_t> gPostUs;      // per request index: when its callback was called
+static std::vector<uint64_t> gDoneUs;      // per request index: when its result came back
+static std::atomic<uint> gDone(0);
+
+
+/* BenchNowUs: monotonic time in microseconds */
+static uint64_t BenchNowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/* BenchRssKb: resident set size of the process */
+static long BenchRssKb(void)
+{
+    long pages = 0, rss = 0;
+
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/* BenchResult: record a result the driver reports to the IDL */
+static void BenchResult(int callbackIndex)
+{
+    gDoneUs[callbackIndex] = BenchNowUs();
+    gDone.fetch_add(1, std::memory_order_release);
+}
+
+void IdlDevCreateResult(int callbackIndex, IdlDev *dev, int idlError) { BenchResult(callbackIndex); }
+void IdlDevDeleteResult(int callbackIndex, IdlDev *dev, int idlError) { BenchResult(callbackIndex); }
+void IdlDevProvisionResult(int callbackIndex, IdlDev *dev, int idlError) { BenchResult(callbackIndex); }
+void IdlDevDeprovisionResult(int callbackIndex, IdlDev *dev, int idlError) { BenchResult(callbackIndex); }
+void IdlDevReplaceResult(int callbackIndex, IdlDev *dev, int idlError) { BenchResult(callbackIndex); }
+void IdlDpWriteResult(int callbackIndex, IdlDev *dev, IdlDatapoint *dp, int idlError) { BenchResult(callbackIndex); }
+void IdlDpReadResult(int callbackIndex, IdlDev *dev, IdlDatapoint *dp, 
+        void *idlContext, int idlError, char *prioArray, double value)
+{
+    BenchResult(callbackIndex);
+}
+
+
+/* BenchDevInit: one device with BENCH_DPS_PER_DEV datapoints at addresses 0.. */
+static void BenchDevInit(T_BenchDev *pBench, uint index)
+{
+    memset(pBench, 0, sizeof(*pBench));
+    snprintf(pBench->unid, sizeof(pBench->unid), "%08u", index);
+    snprintf(pBench->handle, sizeof(pBench->handle), "bench.%u", index);
+    pBench->dev.unid = pBench->unid;
+    pBench->dev.handle = pBench->handle;
+    pBench->dev.firstIfblock = &pBench->ifblock;
+    pBench->ifblock.firstIapdp = &pBench->iapdps[0];
+    for (uint i = 0; i < BENCH_DPS_PER_DEV; i++) {
+        pBench->iapdps[i].dpCnt = 1;
+        pBench->iapdps[i].next = (i + 1 < BENCH_DPS_PER_DEV) ? &pBench->iapdps[i + 1] : NULL;
+        pBench->dps[i].name = (char *)"benchDp";
+        pBench->dps[i].address = i;
+        pBench->dps[i].info.parentIapdp = &pBench->iapdps[i];
+    }
+}
+
+
+/* BenchPost: call a callback until the driver takes the request, as the IDL retries */
+template <typename F> static void BenchPost(uint index, F cb)
+{
+    gPostUs[index] = BenchNowUs();
+    while (cb() == IErr_IdiBusy) {
+        usleep(100);
+    }
+}
+
+
+/* BenchWait: wait until count results came back */
+static void BenchWait(uint count)
+{
+    while (gDone.load(std::memory_order_acquire) < count) {
+        usleep(200);
+    }
+}
+
+
+/* BenchReport: print the callback to result latencies of requests 0..count-1 */
+static void BenchReport(const char *what, uint count, uint64_t elapsedUs)
+{
+    std::vector<uint64_t> lat(count);
+
+    for (uint i = 0; i < count; i++) {
+        lat[i] = gDoneUs[i] - gPostUs[i];
+    }
+    std::sort(lat.begin(), lat.end());
+    printf("  %-8s %8.0f /s   latency p50 %7llu us  p99 %7llu us  max %7llu us\n", what, 
+            count * 1e6 / (elapsedUs ? elapsedUs : 1), (unsigned long long)lat[count / 2], 
+            (unsigned long long)lat[count * 99 / 100], (unsigned long long)lat[count - 1]);
+}
+
+
+/* BenchRun: create count devices and their datapoints, read one datapoint of */
+/* each device, then delete them all                                          */
+static void BenchRun(uint count)
+{
+    T_BenchDev *pDevs = (T_BenchDev *)calloc(count, sizeof(T_BenchDev));
+    uint total = count * BENCH_DPS_PER_DEV;
+
+    gPostUs.assign(total, 0);
+    gDoneUs.assign(total, 0);
+    for (uint i = 0; i < count; i++) {
+        BenchDevInit(&pDevs[i], i);
+    }
+    long rssBefore = BenchRssKb();
+    printf("%u devices, %u datapoints each\n", count, BENCH_DPS_PER_DEV);
+
+    gDone = 0;
+    uint64_t start = BenchNowUs();
+    for (uint i = 0; i < count; i++) {
+        BenchPost(i, [&]{ return OnDevCreateCb(i, &pDevs[i].dev, NULL, NULL); });
+    }
+    BenchWait(count);
+    BenchReport("create", count, BenchNowUs() - start);
+
+    // datapoint creation has no result call, it is done when the datapoint got its storage
+    for (uint i = 0; i < total; i++) {
+        IdlDatapoint *dp = &pDevs[i / BENCH_DPS_PER_DEV].dps[i % BENCH_DPS_PER_DEV];
+        while (OnDpCreateCb(i, &pDevs[i / BENCH_DPS_PER_DEV].dev, dp, NULL) == IErr_IdiBusy) {
+            usleep(100);
+        }
+    }
+    for (uint i = 0; i < total; i++) {
+        while (pDevs[i / BENCH_DPS_PER_DEV].dps[i % BENCH_DPS_PER_DEV].idiDpData == NULL) {
+            usleep(200);
+        }
+    }
+    long rssCreated = BenchRssKb();
+    printf("  memory   %8ld kB   %6.0f bytes per device\n", rssCreated - rssBefore, 
+            (rssCreated - rssBefore) * 1024.0 / count);
+
+    gDone = 0;
+    start = BenchNowUs();
+    for (uint i = 0; i < count; i++) {
+        BenchPost(i, [&]{ return OnDpReadCb(i, &pDevs[i].dev, &pDevs[i].dps[i % BENCH_DPS_PER_DEV], NULL); });
+    }
+    BenchWait(count);
+    BenchReport("read", count, BenchNowUs() - start);
+
+    gDone = 0;
+    start = BenchNowUs();
+    for (uint i = 0; i < count; i++) {
+        BenchPost(i, [&]{ return OnDevDeleteCb(i, &pDevs[i].dev); });
+    }
+    BenchWait(count);
+    BenchReport("delete", count, BenchNowUs() - start);
+
+    for (uint i = 0; i < total; i++) {
+        IdlDatapoint *dp = &pDevs[i / BENCH_DPS_PER_DEV].dps[i % BENCH_DPS_PER_DEV];
+        if (dp->info.rawStringValue && dp->info.rawStringValue != dp->info.actualStringValue) {
+            IdlMemFree(dp->info.rawStringValue);
+        }
+        if (dp->info.actualStringValue) {
+            IdlMemFree(dp->info.actualStringValue);
+        }
+    }
+    free(pDevs);
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint counts[BENCH_MAX_COUNTS] = {1000, 5000, 10000};
+    uint countNum = 3;
+    uint maxCount = 0;
+    pthread_t thread;
+
+    if (argc > 1) {
+        countNum = 0;
+        for (int i = 1; i < argc && countNum < BENCH_MAX_COUNTS; i++) {
+            counts[countNum++] = strtoul(argv[i], NULL, 10);
+        }
+    }
+    for (uint i = 0; i < countNum; i++) {
+        maxCount = std::max(maxCount, counts[i]);
+    }
+
+    FILE *fp = fopen(BENCH_CONF, "w");
+    if (fp == NULL) {
+        err_printf("ERROR: unable to write %s\n", BENCH_CONF);
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, "{ \"about object details\": { \"" DEV_LIMIT_STR "\": %u } }\n", maxCount);
+    fclose(fp);
+
+    if (IdiStart(BENCH_CONF) != 0) {
+        return EXIT_FAILURE;
+    }
+    pthread_create(&thread, NULL, ProcAsynThrdFunc, NULL);
+    for (uint i = 0; i < countNum; i++) {
+        if (counts[i]) {
+            BenchRun(counts[i]);
+        }
+    }
+    unlink(BENCH_CONF);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+//
+// lanes.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Lane scheduling benchmark: one executor worker is handed a backlog of slow device
+// creates and reads, then a write every few milliseconds, and the time each write
+// waited from being posted to being run is reported.  The actions only sleep for as
+// long as the device would take, the executor is driven directly without the IDL.
+// Build with "make bench"; built with CDACTQ=-DIDI_USE_MQUEUE the same backlog goes
+// through the single FIFO queue for comparison.
+//
+
+#include <vector>
+#include <algorithm>
+
+#include "common.h"
+#include "example.h"
+#include "idiexec.h"
+
+#define BENCH_CREATES           500
+#define BENCH_CREATE_US         2000    // time a device create takes
+#define BENCH_READS             2000
+#define BENCH_READ_US           200     // time a datapoint read takes
+#define BENCH_READ_DEVS         100     // devices the reads and writes go to
+#define BENCH_WRITES            100
+#define BENCH_WRITE_GAP_US      5000    // time between two writes posted
+#define BENCH_TIMEOUT_MS        120000  // long enough for no action to expire
+
+static std::atomic<uint> gDone(0);
+static std::vector<uint64_t> gWriteWaitMs;
+static pthread_mutex_t gWriteLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* BenchRunAct: the action run function, takes the time the device would */
+static int BenchRunAct(IdiActionCB& aCB)
+{
+    if (aCB.action == IdiaCreate) {
+        usleep(BENCH_CREATE_US);
+    } else if (aCB.action == IdiaDpread) {
+        usleep(BENCH_READ_US);
+    } else if (aCB.action == IdiaDpwrite) {
+        pthread_mutex_lock(&gWriteLock);
+        gWriteWaitMs.push_back(IdiNowMs() - aCB.exec.enqueueMs);
+        pthread_mutex_unlock(&gWriteLock);
+    }
+    gDone++;
+    return IErr_Success;
+}
+
+
+/* BenchExpireAct: the action expire function, none is expected to expire */
+static int BenchExpireAct(IdiActionCB& aCB)
+{
+    err_printf("ERROR: %s- action %d expired\n", __FUNCTION__, aCB.action);
+    gDone++;
+    return IErr_Success;
+}
+
+
+/* BenchPost: post an action until the executor takes it */
+static void BenchPost(IdiAction action, IdlDev *dev)
+{
+    IdiActionCB aCB = {};
+
+    aCB.action = action;
+    aCB.timeout = BENCH_TIMEOUT_MS;
+    aCB.dev = dev;
+    while (IdiExecPost(aCB) == IErr_IdiBusy) {
+        usleep(100);
+    }
+}
+
+
+/* BenchExecThrd: the executor's worker */
+static void *BenchExecThrd(void *pArg)
+{
+    IdiExecRun();
+    return NULL;
+}
+
+
+int main(void)
+{
+    static IdlDev devs[BENCH_CREATES + BENCH_READ_DEVS];
+    static char handles[BENCH_CREATES + BENCH_READ_DEVS][sizeof("bench.4294967295")];
+    uint posted = 0;
+    pthread_t thread;
+
+    for (uint i = 0; i < BENCH_CREATES + BENCH_READ_DEVS; i++) {
+        snprintf(handles[i], sizeof(handles[i]), "bench.%u", i);
+        devs[i].handle = handles[i];
+    }
+    if (IdiExecInit(1, 0, NULL, BenchRunAct, BenchExpireAct) != SUCCESS || IdiExecStart() != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    pthread_create(&thread, NULL, BenchExecThrd, NULL);
+
+    printf("1 worker, %u creates of %u us and %u reads of %u us queued, a write every %u us\n",
+            BENCH_CREATES, BENCH_CREATE_US, BENCH_READS, BENCH_READ_US, BENCH_WRITE_GAP_US);
+    for (uint i = 0; i < BENCH_CREATES; i++, posted++) {
+        BenchPost(IdiaCreate, &devs[i]);
+    }
+    for (uint i = 0; i < BENCH_READS; i++, posted++) {
+        BenchPost(IdiaDpread, &devs[BENCH_CREATES + i % BENCH_READ_DEVS]);
+    }
+    for (uint i = 0; i < BENCH_WRITES; i++, posted++) {
+        usleep(BENCH_WRITE_GAP_US);
+        BenchPost(IdiaDpwrite, &devs[BENCH_CREATES + i % BENCH_READ_DEVS]);
+    }
+    while (gDone.load() < posted) {
+        usleep(1000);
+    }
+
+    std::sort(gWriteWaitMs.begin(), gWriteWaitMs.end());
+    uint count = gWriteWaitMs.size();
+    printf("  write    wait p50 %6llu ms  p99 %6llu ms  max %6llu ms\n", (unsigned long long)gWriteWaitMs[count / 2],
+            (unsigned long long)gWriteWaitMs[count * 99 / 100], (unsigned long long)gWriteWaitMs[count - 1]);
+
+    return EXIT_SUCCESS;
+}
@@ -43,6 +43,15 @@
 #include "IdlCommon.h"
 #include "libidl.h"
 #include "cJSON.h"
+#include "idiq.h"
+#include "iditimer.h"
+#include "idiindex.h"
+#include "idiebr.h"
+#include "idival.h"
+#include "idisnap.h"
+#include "idienum.h"
+#include "idicodec.h"
+#include "idixform.h"
 
 // Due to an EPR (Jira AP-9580) in Idl library , we have to continue registering the 
 // unrecognized column callback routine via IdlDpUnrecColumnCallbackSet for the 
@@ -68,32 +77,94 @@
 
 
 // Local storage
-typedef cJSON *T_DataPoint, **T_DpValPtr, **T_DpValVector; 
+typedef T_IdiVal T_DataPoint;
+typedef T_IdiReg *T_DpValPtr, *T_DpValVector;
 
 typedef struct _DrvInfo *T_DrvInfoPtr;
 
 typedef struct {
     // pDpValue point to an entry in pDevDpValVector (via dp->address where one or more dp may  
     // use the same dp->address for feedback/loopback (one dp with R/W and the other R/O access)
-    T_DataPoint *pDpValue;
+    T_IdiReg *pDpValue;
     uint address;                       // used in eti example as register number/address 
     double testMultiplier;              // used in the example for showcasing XIF custom/unrecognized column
+    bool bCollapseWrites;               // a queued write of this dp may be superseded by a newer one
+    const T_IdiCodec *pCodec;           // parses the dp's values, NULL if they go through cJSON
+    T_IdiXform xform;                   // the dp's double to and from its register value
 } T_DpSto, *T_DpStoVector;
 
+// A read that joined the queued read of the same device register (single flight)
+typedef struct _IdiReadWaiter {
+    int ReqIndex;
+    IdlDatapoint *dp;
+    void *context;
+    uint64_t deadlineMs;                // when the request it answers times out
+    struct _IdiReadWaiter *pNext;
+} T_IdiReadWaiter;
+
+typedef struct {
+    bool bQueued;                       // a read of this register is queued and has not completed
+    T_IdiReadWaiter *pWaitHead;         // reads answered together with it
+    T_IdiReadWaiter *pWaitTail;
+} T_IdiReadFlight;
+
+// A write that was superseded by a newer write to the same device register (last writer wins)
+typedef struct _IdiWriteWaiter {
+    int ReqIndex;
+    IdlDatapoint *dp;
+    int prio;
+    int relinquish;
+    double dValue;
+    char *rawStringValue;
+    uint64_t deadlineMs;                // when the request it answers times out
+    struct _IdiWriteWaiter *pNext;
+} T_IdiWriteWaiter;
+
+typedef struct {
+    bool bQueued;                       // a write of this register is queued and has not completed
+    T_IdiWriteWaiter *pWaitHead;        // later writes, the tail is the value to apply
+    T_IdiWriteWaiter *pWaitTail;
+} T_IdiWriteFlight;
+
 typedef struct _DevSto {
     char devUid[MAX_UNID_CHARS+1];      // per device device id max 132 characters plus a null terminator
     uint devDpEntry;                    // per device current datapoint entry/count
     uint devDpCounts;                   // per device total datapoint count
-    T_DpValVector pDevDpValVector;      // point to the begining of per device JSON dp values vector
+    T_DpValVector pDevDpValVector;      // point to the begining of per device dp values vector
     T_DpStoVector pDevDpVector;         // point to the begining of per device datapoint struct vector
     T_DrvInfoPtr  pDrvInfo;             // point back to the driver info structure
+    T_IdiReadFlight *pReadFlights;      // per register (dp->address) reads in flight
+    T_IdiWriteFlight *pWriteFlights;    // per register (dp->address) writes in flight
+    pthread_mutex_t flightLock;         // protects the flights, taken by callbacks and workers
+    std::atomic<int> refs;              // the device itself plus the datapoint actions holding it
+    std::atomic<bool> bDeleted;         // deleted, freed once the last holder let go of it
+    uint64_t snapKey;                   // IdiSnapKey of devUid
+    uint32_t *pSnapSlots;               // per register (dp->address) snapshot record, IDI_SNAP_NONE if none
+    const T_IdiCodec **ppRegCodecs;     // per register (dp->address) codec of its first datapoint
+    T_IdiChunkPool *pArenaPool;         // the pool the arena was taken from, NULL if it was calloc'ed
+#ifdef IDI_USE_COROUTINES
+    struct _IdiCoEvent *pRegEvents;     // per register (dp->address) signalled when the device reports it
+#endif
 } T_DevSto, *T__DevStoPtr;
 
-typedef struct _DevNodePtr {
-    T__DevStoPtr pDevSto;
-    _DevNodePtr *pPrevious;
-    _DevNodePtr *pNext;
-} T_DevNode, *T_DevNodePtr;
+// n rounded up to max_align_t, the parts of a device arena and its size are aligned to it
+#define DEV_ARENA_ALIGN(n)      (((n) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+// Layout of the single allocation holding a device's T_DevSto and its per datapoint vectors
+typedef struct {
+    char *pBase;                        // the T_DevSto, at offset 0
+    size_t dpVectorOff;                 // T_DpSto[devDpCounts]
+    size_t dpValVectorOff;              // T_IdiReg[devDpCounts]
+    size_t readFlightsOff;              // T_IdiReadFlight[devDpCounts]
+    size_t writeFlightsOff;             // T_IdiWriteFlight[devDpCounts]
+    size_t snapSlotsOff;                // uint32_t[devDpCounts]
+    size_t regCodecsOff;                // const T_IdiCodec *[devDpCounts]
+#ifdef IDI_USE_COROUTINES
+    size_t regEventsOff;                // T_IdiCoEvent[devDpCounts]
+#endif
+    size_t size;
+    T_IdiChunkPool *pPool;              // the pool it was taken from, NULL if it was calloc'ed
+} T_DevArena;
 
 enum IdiStatus {
     IdiStop = 0,                        // final stop - terminated
@@ -102,12 +173,17 @@ enum IdiStatus {
 
 typedef struct _DrvInfo {
     IdiStatus stat;
-    uint deviceEntry;                   // current device entry/count - up to CDDEVLIMIT
-    T_DevNodePtr pHeadDevNode;
-    mqd_t idiDevActQueue;				// message Queue for sending pending device actions to vTaskIdiDevAct
+    uint deviceEntry;                   // current device entry/count - up to the conf's device max count
+    T_IdiDevIndex devIndex;             // device storage by unid
 #ifdef INCLUDE_ETI
 	struct mosquitto *mosq;			    // mosquitto message queue for all devices
     mqd_t etiDevActQueue;				// message Queue for sending pending device actions to vTaskEtiDevAct
+#ifdef IDI_USE_REACTOR
+    int mosqFd;                         // MQTT socket registered with the reactor, -1 when disconnected
+    bool bMosqWantWrite;                // the socket is watched for EPOLLOUT
+    uint64_t mosqMiscMs;                // next mosquitto_loop_misc
+    uint64_t mosqRetryMs;               // next reconnect attempt
+#endif
 #endif
 } T_DrvInfo;
 
@@ -31,6 +31,10 @@
 #ifdef INCLUDE_ETI
 
 #include "eti.h"
+#ifdef IDI_USE_REACTOR
+#include "idireactor.h"
+#endif
+#include "idicoro.h"
 
 
 
@@ -56,17 +60,28 @@ static int GetTopicField(char *topic, int key, char *field)
 }
 
 
+/* DevUnidGet: copy the device's unid, which IdiIndexRekey may change meanwhile */
+static void DevUnidGet(T__DevStoPtr pDev, char *unid)
+{
+    IdiIndexReadLock(&pDev->pDrvInfo->devIndex);
+    strcpy(unid, unidOf(pDev));
+    IdiIndexReadUnlock(&pDev->pDrvInfo->devIndex);
+}
+
+
 /* DevReadPublish: a utility function for publishing ETI read category topic messages */
 int DevReadPublish(T__DevStoPtr pDev, uint reg)
 {
     char topicStr[MQTT_TOPIC_SIZE] = {0};
+    char unid[MAX_UNID_CHARS+1];
     int retVal = FAILURE;
 
 	// ETI_CAT_DEV_REG_ID_TOPIC_FMT is not a retained topic
 	// "eti/0/wr/dev/%s/reg/%d" {"value":"%s"}
 
 	if (reg < regMaxOf(pDev)) {
-		sprintf(topicStr, ETI_CAT_DEV_REG_ID_TOPIC_FMT, ETI_CAT_RD_STR, unidOf(pDev), reg);
+		DevUnidGet(pDev, unid);
+		sprintf(topicStr, ETI_CAT_DEV_REG_ID_TOPIC_FMT, ETI_CAT_RD_STR, unid, reg);
 
         int pubQoS = MQTT_PUB_QOS;
         bool bRetain = RETAIN_FALSE;
@@ -88,19 +103,19 @@ int DevReadPublish(T__DevStoPtr pDev, uint reg)
 
 
 /* DevWritePublish: a utility function for publishing ETI write category topic messages */
-int DevWritePublish(T__DevStoPtr pDev, uint reg, cJSON *pJsonNewVal)
+int DevWritePublish(T__DevStoPtr pDev, uint reg, const char *outStr)
 {
     char topicStr[MQTT_TOPIC_SIZE] = {0};
-    char *outStr = NULL;
+    char unid[MAX_UNID_CHARS+1];
     int retVal = FAILURE;
 
 	// ETI_CAT_DEV_REG_ID_TOPIC_FMT is not a retained topic
 	// "eti/CDNAME/wr/dev/%s/reg/%d" {"value":"%s"}
 
-	if (regValVectorOf(pDev) && reg < regMaxOf(pDev)) {
-		sprintf(topicStr, ETI_CAT_DEV_REG_ID_TOPIC_FMT, ETI_CAT_WR_STR, unidOf(pDev), reg);
+	if (regValVectorOf(pDev) && reg < regMaxOf(pDev) && outStr) {
+		DevUnidGet(pDev, unid);
+		sprintf(topicStr, ETI_CAT_DEV_REG_ID_TOPIC_FMT, ETI_CAT_WR_STR, unid, reg);
 
-		outStr = cJSON_PrintUnformatted(pJsonNewVal);
         int pubQoS = MQTT_PUB_QOS;
         bool bRetain = RETAIN_FALSE;
 		dbg_printf("%s Publishing:\n  Topic:%s\n  Data:%s - with QOS=%d, retain=%s\n",  __FUNCTION__,
@@ -110,10 +125,10 @@ int DevWritePublish(T__DevStoPtr pDev, uint reg, cJSON *pJsonNewVal)
 			err_printf("ERROR: %s- mosquitto_publish failed on topic=%s msg=%s\n",
 						__FUNCTION__, topicStr, outStr);
 		}
-		/* clean-up */
-		free(outStr);
 	} else {
-		if (regValVectorOf(pDev))
+		if (regValVectorOf(pDev) && outStr == NULL)
+			err_printf("ERROR: %s- reg[%d] has no value to write\n", __FUNCTION__, reg);
+		else if (regValVectorOf(pDev))
 			err_printf("ERROR: %s- reg[%d] is not a valid register\n", __FUNCTION__, reg);
 		else
 			err_printf("ERROR: %s- pDev->regValuesVector is not initialized\n", __FUNCTION__);
@@ -123,6 +138,14 @@ int DevWritePublish(T__DevStoPtr pDev, uint reg, cJSON *pJsonNewVal)
 }
 
 
+/* DevRegSnapStore: keep the register's new value in the register snapshot */
+static void DevRegSnapStore(T__DevStoPtr pDev, uint reg)
+{
+    IdiSnapStore(__atomic_load_n(&pDev->pSnapSlots[reg], __ATOMIC_ACQUIRE), 
+                    __atomic_load_n(&pDev->snapKey, __ATOMIC_ACQUIRE), &regValOf(pDev, reg));
+}
+
+
 /* DevEvHndl: a function for processing ETI device register's event messages */
 static int DevRegEvHndl(T__DevStoPtr pDev, char *pUnid, char *topic, char *msg) 
 {
@@ -138,31 +161,24 @@ static int DevRegEvHndl(T__DevStoPtr pDev, char *pUnid, char *topic, char *msg)
             T_DpValPtr pRegValEntry = &regValOf(pDev, reg);
             if (msg && strlen(msg) > 0) {
                 // info_printf("INFO %s: regId=%s, msg=%s\n", __FUNCTION__, regId,  msg);
-                cJSON *pNewValJson = IdlStringTocJSON(msg);
-                if (pNewValJson) {
-                    char *pNewVal = cJSON_PrintUnformatted(pNewValJson);
-                    info_printf("INFO %s: set pNewValJson=%s into reg[%d]\n", __FUNCTION__, pNewVal, reg);
-                    if (*pRegValEntry) {
-                        if (cJSON_Compare(*pRegValEntry, pNewValJson, 0)) {
-                            // same value, no need to replace but free new value
-                            cJSON_free(pNewValJson);
-                        } else {
-                            // different value, free old and replace with new
-                            cJSON_free(*pRegValEntry);
-                            *pRegValEntry = pNewValJson;
-                        }
-                    } else {
-                        // no existing value, save new value
-                        *pRegValEntry = pNewValJson;
+                T_IdiVal newVal = {};
+                if (IdiCodecParse(__atomic_load_n(&pDev->ppRegCodecs[reg], __ATOMIC_ACQUIRE), &newVal, msg) == SUCCESS) {
+                    info_printf("INFO %s: set pNewVal=%s into reg[%d]\n", __FUNCTION__, msg, reg);
+                    // replaced only if different, readers of the old value keep it until they are done
+                    if (IdiRegStore(pRegValEntry, &newVal)) {
+                        DevRegSnapStore(pDev, reg);
                     }
-                    cJSON_free(pNewVal);
                 } else {
-                    // dbg_printf("%s: pNewValJson is null for reg[%d]\n", __FUNCTION__, reg);
+                    // dbg_printf("%s: pNewVal is not valid for reg[%d]\n", __FUNCTION__, reg);
                 }
             } else {
-                cJSON_free(*pRegValEntry);
-                *pRegValEntry = NULL;
+                IdiRegClear(pRegValEntry);
+                DevRegSnapStore(pDev, reg);
             }
+#ifdef IDI_USE_COROUTINES
+            // a read flow waiting for the device to report the register can answer now
+            IdiCoSignal(&pDev->pRegEvents[reg]);
+#endif
         } else {
             err_printf("ERROR: %s- reg[%u] is not a valid register in the ev topic=%s\n", __FUNCTION__, reg, topic);
         }
@@ -193,33 +209,19 @@ static int DevEvHndl(T_DrvInfoPtr pDrvInfo, char *topic, char *msg)
                 strcpy(tempStr, topic);
                 if ((GetTopicField(tempStr, ETI_REG_KEY_INDEX, topicId) == SUCCESS) &&
                     (strcmp(topicId, ETI_REG_KEY) == 0)) {
-                    bool bFound = false;
-
-                    // We linearly walk through the list of nodes to find the proper node with
-                    // matching unid.. It's not efficient but does the job for this eti example
-                    T_DevNodePtr pDevStorNode = pDrvInfo->pHeadDevNode;
-                    // dbg_printf("%s: searching for device with unid=%s in the pHeadDevNode(%p) list\n",
-                    //                 __FUNCTION__, unid, pDrvInfo->pHeadDevNode);
-                    while (pDevStorNode) {
-                        // dbg_printf("%s: processing device with unid=%s in the pDevStorNode(%p) list\n", 
-                        //            __FUNCTION__, unidOfNode(pDevStorNode), pDevOfNode(pDevStorNode));
-                        if (strcmp(unidOfNode(pDevStorNode), unid) == 0) {
-                            // found the device node ptr
-                            retVal = DevRegEvHndl(pDevOfNode(pDevStorNode), unidOfNode(pDevStorNode), topic, msg);
-                            bFound = true;
-                            break;
-                        }
-                        pDevStorNode = pNextOfNode(pDevStorNode);
-                        // it's a doubly linked list
-                        if (pDevStorNode == pDrvInfo->pHeadDevNode) {
-                            // dbg_printf("%s: done processing (end of list)\n", __FUNCTION__);
-                            break; // we are done
-                        }
-                    }
-                    if (!bFound) {
-                        err_printf("ERROR: %s- unable to find device with unid=%s in the pHeadDevNode list\n", 
+                    // the epoch section keeps the storage of a device deleted meanwhile from being
+                    // freed while its register is updated, the index lock is only held for the lookup
+                    IdiEbrEnter();
+                    IdiIndexReadLock(&pDrvInfo->devIndex);
+                    T__DevStoPtr pDev = IdiIndexFind(&pDrvInfo->devIndex, unid);
+                    IdiIndexReadUnlock(&pDrvInfo->devIndex);
+                    if (pDev) {
+                        retVal = DevRegEvHndl(pDev, unid, topic, msg);
+                    } else {
+                        err_printf("ERROR: %s- unable to find device with unid=%s in the device index\n", 
                                     __FUNCTION__, unid);
                     }
+                    IdiEbrExit();
                 } else {
                     err_printf("ERROR: %s- no reg key found in the ev topic\n", __FUNCTION__);
                     err_printf("ERROR: %s- ev topic; %s\n", __FUNCTION__, topic);
@@ -235,6 +237,7 @@ static int DevEvHndl(T_DrvInfoPtr pDrvInfo, char *topic, char *msg)
 }
 
 
+#ifndef IDI_USE_REACTOR
 /* vTaskEtiDevAct: a thread function to handle all ETI device related operations */
 static void *vTaskEtiDevAct(void *pvArg)
 {
@@ -281,6 +284,7 @@ static const char *GetCategoryStr(MsgCategory cat) {
 
 	return ETI_CAT_IV_STR;
 }
+#endif
 
 
 /* EtiMessageCb: a MQTT callback function for processing ETI device category topic */
@@ -319,14 +323,21 @@ static void EtiMessageCb(struct mosquitto *mosq, void *obj, const struct mosquit
 
 	dbg_printf("%s Topic :    %s\n", __FUNCTION__, dmsg.topic);
 	dbg_printf("%s Data :     %s\n", __FUNCTION__, (char *)(dmsg.payload));
-	dbg_printf("%s Category : %s\n", __FUNCTION__, GetCategoryStr(dmsg.category));
 
+#ifdef IDI_USE_REACTOR
+	// already on the reactor thread, no need to hand it over to vTaskEtiDevAct
+	DevEvHndl(pDrvInfo, dmsg.topic, dmsg.payload);
+	free(dmsg.topic);
+	free(dmsg.payload);
+#else
+	dbg_printf("%s Category : %s\n", __FUNCTION__, GetCategoryStr(dmsg.category));
 	if (mq_send(pDrvInfo->etiDevActQueue, (const char*)&dmsg, sizeof(dmsg), 1) != 0) {    
 		err_printf("WARN: %s- Failed to send data (topic:%s, cat:%s) to etiDevActQueue, err=%d\n",
 				__FUNCTION__, dmsg.topic, GetCategoryStr(dmsg.category), errno);
 	} else {
 		dbg_printf("%s Sent msg on etiDevActQueue\n", __FUNCTION__);
 	}
+#endif
 }
 
 
@@ -345,6 +356,66 @@ static int SubToDeviceCatTopic(T_DrvInfoPtr pDrvInfo, const char *cat, const cha
 }
 
 
+#ifdef IDI_USE_REACTOR
+/* EtiMosqIo: reactor callback for the MQTT socket */
+static void EtiMosqIo(int fd, uint32_t events, void *pvArg)
+{
+	T_DrvInfoPtr pDrvInfo = (T_DrvInfoPtr) pvArg;
+
+	if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+		mosquitto_loop_read(pDrvInfo->mosq, 1);
+	}
+	if ((events & EPOLLOUT) && mosquitto_socket(pDrvInfo->mosq) == fd) {
+		mosquitto_loop_write(pDrvInfo->mosq, 1);
+	}
+}
+
+
+/* EtiMosqTick: reactor tick doing what mosquitto_loop_start's thread did: keepalive, */
+/* following the client socket across reconnects and watching it for writes that are  */
+/* pending.  Returns how long the reactor may sleep.                                  */
+static int EtiMosqTick(void *pvArg)
+{
+	T_DrvInfoPtr pDrvInfo = (T_DrvInfoPtr) pvArg;
+	uint64_t now = IdiNowMs();
+	int fd = mosquitto_socket(pDrvInfo->mosq);
+
+	if (fd != pDrvInfo->mosqFd) {
+		if (pDrvInfo->mosqFd >= 0) {
+			IdiReactorDel(pDrvInfo->mosqFd);
+		}
+		pDrvInfo->mosqFd = -1;
+		pDrvInfo->bMosqWantWrite = false;
+		if (fd >= 0 && IdiReactorAdd(fd, EPOLLIN, EtiMosqIo, pDrvInfo) == SUCCESS) {
+			pDrvInfo->mosqFd = fd;
+		}
+	}
+	if (fd < 0) {
+		if (now >= pDrvInfo->mosqRetryMs) {
+			pDrvInfo->mosqRetryMs = now + ETI_MOSQ_RETRY_MS;
+			if (mosquitto_reconnect(pDrvInfo->mosq) == MOSQ_ERR_SUCCESS) {
+				info_printf("INFO: %s- reconnected to the MQTT broker\n", __FUNCTION__);
+				SubToDeviceCatTopic(pDrvInfo, ETI_CAT_EV_STR, WILDCARD_SUB_PLUS);
+				return 0;
+			}
+		}
+		return (int)(pDrvInfo->mosqRetryMs - now);
+	}
+	if (now >= pDrvInfo->mosqMiscMs) {
+		mosquitto_loop_misc(pDrvInfo->mosq);
+		pDrvInfo->mosqMiscMs = now + ETI_MOSQ_MISC_MS;
+	}
+	bool bWantWrite = mosquitto_want_write(pDrvInfo->mosq);
+	if (bWantWrite != pDrvInfo->bMosqWantWrite && 
+			IdiReactorMod(fd, EPOLLIN | (bWantWrite ? (uint32_t)EPOLLOUT : 0)) == SUCCESS) {
+		pDrvInfo->bMosqWantWrite = bWantWrite;
+	}
+	return (int)(pDrvInfo->mosqMiscMs - now);
+}
+#endif
+
+
+#ifndef IDI_USE_REACTOR
 /* CreateThread: a utility function to create a pthread */
 static int CreateThread(pthread_t *pThreadHndl, const char *name, int stackSize, 
         void *(*startRoutine) (void *), void *arg)
@@ -373,6 +444,7 @@ static int CreateThread(pthread_t *pThreadHndl, const char *name, int stackSize,
 
     return retVal;
 }
+#endif
 
 
 pthread_t* EtiInit(T_DrvInfoPtr pDrvInfo)
@@ -381,8 +453,13 @@ pthread_t* EtiInit(T_DrvInfoPtr pDrvInfo)
 	int rc = SUCCESS;
     char qName[FIELD_LENGTH];
 
+#ifdef IDI_USE_REACTOR
+    // events are handled on the reactor thread, there is no queue to vTaskEtiDevAct
+    sprintf(qName, "reactor");
+#else
     sprintf(qName, ETI_ACT_Q, CDNAME);
 	rc = IdiCreateQueue(&pDrvInfo->etiDevActQueue, qName, BLOCKING_Q, MQ_HARD_LIM, sizeof(EtiDevActData));
+#endif
 	if (rc != SUCCESS) {
         info_printf("INFO: IdiCreateQueue %s failed\n", qName);
 	} else {
@@ -418,6 +495,12 @@ pthread_t* EtiInit(T_DrvInfoPtr pDrvInfo)
                 /* Subscribe to the Example Test I/O (ETI) MQTT ev for wildcard dev topic */
                 SubToDeviceCatTopic(pDrvInfo, ETI_CAT_EV_STR, WILDCARD_SUB_PLUS);
                 
+#ifdef IDI_USE_REACTOR
+                // the reactor drives the client socket instead of mosquitto_loop_start's thread
+                pDrvInfo->stat = IdiRunning;
+                pDrvInfo->mosqFd = -1;
+                IdiReactorTickSet(EtiMosqTick, pDrvInfo);
+#else
                 if (CreateThread(&threadDevAct, "vTaskEtiDevAct", TASK_DEVACT_STACK_SIZE, 
                                                 vTaskEtiDevAct, pDrvInfo) == SUCCESS) {
                     if (mosquitto_loop_start(pDrvInfo->mosq) != 0) {
@@ -428,6 +511,7 @@ pthread_t* EtiInit(T_DrvInfoPtr pDrvInfo)
                     rc = FAILURE;
                     err_printf("ERROR: %s- create vTaskEtiDevAct thread failed\n", __FUNCTION__);
                 }
+#endif
 
             }
         } else {
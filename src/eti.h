@@ -11,6 +11,9 @@
 #define ETI_ACT_Q               "/dev_act_q_eti_%s"
 #define ETI_MOSQ_CLIENT_ID      "eti_client_%s"
 
+#define ETI_MOSQ_MISC_MS        1000    // MQTT keepalive housekeeping period in reactor mode
+#define ETI_MOSQ_RETRY_MS       5000    // reconnect attempt period in reactor mode
+
 #define MQTT_SUB_QOS            1
 #define MQTT_PUB_QOS            1
 #define RETAIN_TRUE             1
@@ -49,9 +52,6 @@ typedef enum {
 #define ETI_CAT_DEV_SUBSC_TOPIC_FMT     "eti/" CDNAME "/%s/dev/%s/reg/#"
 
 
-#define pDevOfNode(pNode)       (pNode->pDevSto)
-#define unidOfNode(pNode)       (pNode->pDevSto->devUid)
-#define pNextOfNode(pNode)      (pNode->pNext)
 #define unidOf(pDev)            (pDev->devUid)
 #define regMaxOf(pDev)          (pDev->devDpCounts)
 #define regValVectorOf(pDev)    (pDev->pDevDpValVector)
@@ -68,7 +68,7 @@ typedef struct _DevActData {
 
 extern pthread_t* EtiInit(T_DrvInfoPtr pDrvInfo);
 extern int DevReadPublish(T__DevStoPtr pDev, uint reg);
-extern int DevWritePublish(T__DevStoPtr pDev, uint reg, cJSON *pJsonNewVal);
+extern int DevWritePublish(T__DevStoPtr pDev, uint reg, const char *outStr);
 
 
 #endif
\ No newline at end of file
@@ -27,6 +27,14 @@
 
 #include "common.h"
 #include "example.h"
+#include "idiexec.h"
+#include "idiconf.h"
+#ifdef IDI_USE_REACTOR
+#include "idireactor.h"
+#endif
+#ifdef IDI_USE_COROUTINES
+#include "idicoro.h"
+#endif
 
 
 #ifndef CDNAME
@@ -40,6 +48,13 @@
 extern Idl *idl;
 
 static T_DrvInfo gDrvInfo = {};
+static T_IdiConf gIdiConf = {};
+static T_IdiChunkPool gDevArenaPools[IDI_DEV_ARENA_POOLS] = {};  // device arenas, one pool per arena size
+static pthread_mutex_t gDevArenaLock = PTHREAD_MUTEX_INITIALIZER;    // taken to pick or set up a pool
+static T_IdiPool gReadWaiterPool = {};     // T_IdiReadWaiter entries of coalesced reads
+static T_IdiPool gWriteWaiterPool = {};    // T_IdiWriteWaiter entries of collapsed writes
+static pthread_t gAsynThread;               // serves action shard 0, see ProcAsynThrdFunc
+static bool gbAsynThread = false;
 
 
 // Dummy value and priority array for sake of this driver
@@ -48,21 +63,85 @@ static T_DrvInfo gDrvInfo = {};
 static char *prio_array = NULL;
 
 
-static int IdiBlockWhileBusy(IdiActionCB& pActCb);
+static int IdiActionTimeout(IdiActionCB& pActCb);
+static int IdiPostRead(IdiActionCB& aCB);
+static T_IdiReadWaiter *IdiReadDetach(IdiActionCB& aCB);
+static T_IdiReadWaiter *IdiReadExpire(IdiActionCB& aCB);
+static void IdiReadReport(IdiActionCB& aCB, T_IdiReadWaiter *pWaiters, int idlError);
+static int IdiPostWrite(IdiActionCB& aCB);
+static T_IdiWriteWaiter *IdiWriteDetach(IdiActionCB& aCB, IdiActionCB *pNewest);
+static T_IdiWriteWaiter *IdiWriteExpire(IdiActionCB& aCB);
+static void IdiWriteReport(IdiActionCB& aCB, T_IdiWriteWaiter *pWaiters, int idlError);
+static void IdiActionResult(IdiActionCB& pActCb, int idlError);
 static int IdiGenericResultFsm(IdiActionCB& pActCb);
-static cJSON *GetDpValForLocStorUpdate(IdiActionCB& pActCb);
-static cJSON *GenerateDpDefVal(IdlDatapoint *dp);
+static int IdiDpReadApply(IdiActionCB& aCB, bool bAsk);
+static int IdiDpWriteApply(IdiActionCB& aCB);
+#ifdef IDI_USE_COROUTINES
+static IdiTask IdiCoDevCreate(IdiActionCB& aCB);
+static IdiTask IdiCoDpRead(IdiActionCB& aCB);
+static IdiTask IdiCoDpWrite(IdiActionCB& aCB);
+#endif
+static void SetDpValForLocStorUpdate(IdiActionCB& pActCb, T_DataPoint *pDpVal);
+static void GenerateDpDefVal(IdlDatapoint *dp, const T_DpSto *pDpStruc, T_DataPoint *pDpVal);
 
 
 
 /* IdiStart: Custom driver startup function called from main.cpp  */
-int IdiStart() 
+int IdiStart(const char *confPath) 
 {
 	/* Your custom IDL driver can start up any other driver-specific  */
 	/* actions here.  For example, you could open a connection to a   */
 	/* serial port or a USB interface.  You should return a 0 here    */
 	/* if your code started up your driver properly or else return 1. */
 
+    IdiConfLoad(confPath, &gIdiConf);
+    if (IdiIndexInit(&gDrvInfo.devIndex, gIdiConf.devMaxCount) != SUCCESS) {
+        return 1;
+    }
+    // registers of the devices known before a restart start out with their last values
+    if (gIdiConf.snapRegsPerDev) {
+        const char *pDataPath = getenv("APOLLO_DATA");
+        char snapDir[256];
+        char xifDir[sizeof(snapDir) + sizeof("/res")];
+        snprintf(snapDir, sizeof(snapDir), "%s/" CDNAME, pDataPath ? pDataPath : "/var/apollo/data");
+        snprintf(xifDir, sizeof(xifDir), "%s/res", snapDir);
+        IdiSnapOpen(snapDir, xifDir, gIdiConf.devMaxCount * gIdiConf.snapRegsPerDev, gIdiConf.snapFlushMs);
+    }
+
+    // the action queue has to exist before IdlInit() starts invoking the callbacks
+    if (IdiPoolInit(&gReadWaiterPool, gIdiConf.queueDepth, sizeof(T_IdiReadWaiter)) != SUCCESS ||
+            IdiPoolInit(&gWriteWaiterPool, gIdiConf.queueDepth, sizeof(T_IdiWriteWaiter)) != SUCCESS) {
+        return 1;
+    }
+#ifdef IDI_USE_COROUTINES
+    // create, read and write run as coroutine flows, everything else through the FSM
+    if (IdiCoInit(gIdiConf.queueDepth, IdiGenericResultFsm, IdiActionTimeout) != SUCCESS) {
+        return 1;
+    }
+    IdiCoFlowSet(IdiaCreate, IdiCoDevCreate);
+    IdiCoFlowSet(IdiaDpread, IdiCoDpRead);
+    IdiCoFlowSet(IdiaDpwrite, IdiCoDpWrite);
+    if (IdiExecInit(IDI_WORKERS, gIdiConf.queueDepth, gIdiConf.lanes, IdiCoRun, 
+                    IdiCoExpire) != SUCCESS) {
+        return 1;
+    }
+#else
+    if (IdiExecInit(IDI_WORKERS, gIdiConf.queueDepth, gIdiConf.lanes, IdiGenericResultFsm, 
+                    IdiActionTimeout) != SUCCESS) {
+        return 1;
+    }
+#endif
+    // every shard has its worker before IdlInit() starts posting actions
+    if (IdiExecStart() != SUCCESS) {
+        return 1;
+    }
+#ifdef IDI_USE_REACTOR
+    // EtiInit registers the MQTT socket with it
+    if (IdiReactorInit() != SUCCESS) {
+        return 1;
+    }
+#endif
+
     info_printf("INFO %s: The " CDNAME " IDL driver is connected and ready...\n", 
                     __FUNCTION__);
 
@@ -74,28 +153,42 @@ int IdiStart()
 }
 
 
+/* IdiShutdown: Custom driver shutdown function called from main.cpp  */
+void IdiShutdown(void)
+{
+    // no action changes a register any more while the last changes are written back
+    IdiExecStop();
+    if (__atomic_exchange_n(&gbAsynThread, false, __ATOMIC_ACQ_REL)) {
+        pthread_join(gAsynThread, NULL);
+    }
+    // the register values changed since the last flush go to the snapshot file
+    IdiSnapClose();
+}
+
+
 /* IdiCreateQueue: a utility function to create a message queue for further  */
 /* processing of device actions by an asynch action processing thread        */
 int IdiCreateQueue(mqd_t *queueHndl, const char *name, int isBlocking, int queueSize, int msgSize)
 {
-    long hardLimit = 0;
     int ret = FAILURE;
     int qFlags = 0;
     mode_t qPerms = {0};
     struct mq_attr qAttr = {0};
     struct rlimit mqLimit = {0};
 
-    if (getrlimit(RLIMIT_MSGQUEUE, &mqLimit) == 0) {
-        hardLimit = mqLimit.rlim_max;
+    // make room for this queue in the soft limit, within the hard limit set for the process
+    rlim_t needed = (rlim_t)queueSize * (msgSize + IDI_MQ_MSG_OVERHEAD);
+    if (getrlimit(RLIMIT_MSGQUEUE, &mqLimit) == 0 && mqLimit.rlim_cur != RLIM_INFINITY) {
         dbg_printf("%s Old mqLlimit -> soft limit= %ld, hard limit= %ld\n", __FUNCTION__, 
-                        mqLimit.rlim_cur, mqLimit.rlim_max); 
-        if (hardLimit <= 0xfffffff) {
-            hardLimit = 0xfffffff;
-            mqLimit.rlim_max = hardLimit;
-            mqLimit.rlim_cur = hardLimit;
+                        (long)mqLimit.rlim_cur, (long)mqLimit.rlim_max); 
+        rlim_t wanted = mqLimit.rlim_cur + needed;
+        if (mqLimit.rlim_max != RLIM_INFINITY && wanted > mqLimit.rlim_max) {
+            wanted = mqLimit.rlim_max;
+        }
+        if (wanted > mqLimit.rlim_cur) {
+            mqLimit.rlim_cur = wanted;
             if (setrlimit(RLIMIT_MSGQUEUE, &mqLimit) == 0) {
-                dbg_printf("%s successfully set limits\n", __FUNCTION__);
-                dbg_printf("%s new hardLimit = %ld\n", __FUNCTION__, hardLimit);
+                dbg_printf("%s new soft limit = %ld\n", __FUNCTION__, (long)wanted);
             } else {
                 dbg_printf("%s error in setting mqlimit, errno = %d\n", __FUNCTION__, errno);
             }
@@ -179,6 +272,27 @@ static const char *IErrToStr(int errCode)
 }
 
 
+/* DpCodecOf: the codec of a datapoint's values, by the XIF IAP type of its IAP datapoint */
+/* and the field it is mapped to.  A datapoint mapped to no single field has the whole  */
+/* type; text of another shape than the codec's still goes through cJSON.               */
+static const T_IdiCodec *DpCodecOf(const IdlDatapoint *dp)
+{
+    const IdlIapDatapoint *pIapDp = dp->info.parentIapdp;
+    const char *pIapField = "";
+    int fieldCount = 0;
+
+    if (pIapDp == NULL) {
+        return NULL;
+    }
+    for (const IapTypeValueFields *pField = pIapDp->firstField; pField; pField = pField->next) {
+        if (pField->dp == dp) {
+            pIapField = (++fieldCount == 1 && pField->fieldName) ? pField->fieldName : "";
+        }
+    }
+    return IdiCodecOf(pIapDp->info.xifIapType, pIapField);
+}
+
+
 /* DpSetCustomIdiDpData: a utility function to setup datapoint specific pointers/offsets in */
 /* device's storage area.                                                                   */
 static int DpSetCustomIdiDpData(IdlDev *dev, IdlDatapoint *dp)
@@ -193,23 +307,37 @@ static int DpSetCustomIdiDpData(IdlDev *dev, IdlDatapoint *dp)
                 address < pDevEntry->devDpCounts) {
                 // initialize local datapoint storage and idiDpData to point to this entry in storage vector
                 T_DpSto *pDpStruct = &pDevEntry->pDevDpVector[pDevEntry->devDpEntry];
+                // values of the IAP types known from the XIF files are parsed without cJSON,
+                // the ETI events of a register take the codec of its first datapoint
+                pDpStruct->pCodec = DpCodecOf(dp);
+                if (__atomic_load_n(&pDevEntry->ppRegCodecs[address], __ATOMIC_ACQUIRE) == NULL) {
+                    __atomic_store_n(&pDevEntry->ppRegCodecs[address], pDpStruct->pCodec, __ATOMIC_RELEASE);
+                }
+                // the enum map is searched on every value converted, its table is built once; the
+                // TestMultiplier column is compiled in once the custom columns are processed
+                IdiXformCompile(&pDpStruct->xform, IdiEnumTabGet(&dp->info.iapEnum), dp->info.scale.isInvalidPresent, 
+                                dp->info.dflt.value, 1);
                 // set pDpValue to point to the pDevDpValVector[dp->address] entry
                 pDpStruct->pDpValue = &(pDevEntry->pDevDpValVector[address]);
                 dbg_printf(" %s: pDpStruct = %p, pDpStruct->pDpValue = %p\n", __FUNCTION__, pDpStruct, pDpStruct->pDpValue);
+                // a device known before the restart gets the register's last value from the snapshot
+                if (pDevEntry->pSnapSlots[address] == IDI_SNAP_NONE) {
+                    uint32_t slot = IdiSnapAttach(pDevEntry->snapKey, address, &pDevEntry->pDevDpValVector[address]);
+                    __atomic_store_n(&pDevEntry->pSnapSlots[address], slot, __ATOMIC_RELEASE);
+                }
                 // check if the pDevDpValVector[dp->address] entry has possibly been initialized by other 
                 // datapoints with the same address (defined in device's XIF)
-                if (!pDevEntry->pDevDpValVector[address]) {
-                    cJSON *pDefaultJSON = GenerateDpDefVal(dp);
-                    pDevEntry->pDevDpValVector[address] = pDefaultJSON;
-
-                    char *jsonStr = cJSON_PrintUnformatted(*pDpStruct->pDpValue);
-                    dbg_printf(" %s: dp.name=%s, dp.address=%d, devDpEntry=%d, &pDevEntry->pDevDpValVector[dp->address]=%p, dpValue=%s\n",
+                if (!IdiRegHasValue(&pDevEntry->pDevDpValVector[address])) {
+                    T_DataPoint dfltVal = {};
+                    GenerateDpDefVal(dp, pDpStruct, &dfltVal);
+                    IdiRegStoreIfNone(&pDevEntry->pDevDpValVector[address], &dfltVal);
+                    dbg_printf(" %s: dp.name=%s, dp.address=%d, devDpEntry=%d, &pDevEntry->pDevDpValVector[dp->address]=%p\n",
                                 __FUNCTION__, dp->name, address, pDevEntry->devDpEntry, 
-                                &pDevEntry->pDevDpValVector[address], jsonStr);
-                    IdlMemFree(jsonStr);
+                                &pDevEntry->pDevDpValVector[address]);
                 }
                 // set idiDpData to point to an entry in per device's DevDpStorage, record the address & increment the datapoint entry
                 pDpStruct->address = address;
+                pDpStruct->bCollapseWrites = IdiConfCollapsesWrites(&gIdiConf, dp);
                 dp->idiDpData = pDpStruct;
                 pDevEntry->devDpEntry++;
             } else {
@@ -237,8 +365,19 @@ static int DevReplaceUnid(IdlDev *dev) {
     T__DevStoPtr pLocDevStorageStruc = (T__DevStoPtr)dev->idiDevData;
     if (pLocDevStorageStruc) {
         if (dev->unid) {
-            strncpy(pLocDevStorageStruc->devUid, dev->unid, sizeof(pLocDevStorageStruc->devUid));
-            pLocDevStorageStruc->devUid[MAX_UNID_CHARS] = '\0'; // forced string termination
+            // reindex the device under its new unid
+            IdiIndexRekey(&gDrvInfo.devIndex, pLocDevStorageStruc, dev->unid);
+            // and keep its registers in the snapshot under that unid
+            uint64_t snapKey = IdiSnapKey(pLocDevStorageStruc->devUid);
+            __atomic_store_n(&pLocDevStorageStruc->snapKey, snapKey, __ATOMIC_RELEASE);
+            for (uint i = 0; i < pLocDevStorageStruc->devDpCounts; i++) {
+                uint32_t slot = pLocDevStorageStruc->pSnapSlots[i];
+                if (slot != IDI_SNAP_NONE) {
+                    IdiSnapDetach(slot);
+                    slot = IdiSnapAttach(snapKey, i, &pLocDevStorageStruc->pDevDpValVector[i]);
+                    __atomic_store_n(&pLocDevStorageStruc->pSnapSlots[i], slot, __ATOMIC_RELEASE);
+                }
+            }
         }
         idlError = IErr_Success;
     }
@@ -246,6 +385,58 @@ static int DevReplaceUnid(IdlDev *dev) {
 }
 
 
+/* DevArenaPoolOf: the pool of the arenas of size bytes, set up for the first device of  */
+/* that size.  The devices of one XIF share their datapoint count and so the arena size, */
+/* NULL once IDI_DEV_ARENA_POOLS sizes are pooled.                                        */
+static T_IdiChunkPool *DevArenaPoolOf(size_t size)
+{
+    T_IdiChunkPool *pPool = NULL;
+
+    pthread_mutex_lock(&gDevArenaLock);
+    for (uint i = 0; i < IDI_DEV_ARENA_POOLS; i++) {
+        if (gDevArenaPools[i].objSize == 0) {
+            // arenas are allocated IDI_DEV_CHUNK devices at a time up to the configured count
+            IdiChunkPoolInit(&gDevArenaPools[i], size, IDI_DEV_CHUNK, gIdiConf.devMaxCount);
+        }
+        if (gDevArenaPools[i].objSize == size) {
+            pPool = &gDevArenaPools[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gDevArenaLock);
+
+    return pPool;
+}
+
+
+/* DevArenaAlloc: take one zeroed block for the device storage of a device with dpCount  */
+/* datapoints from the pool of its size, calloc it if there is none or the pool is used  */
+/* up, and fill in where its parts are.  NULL if the allocation fails.                    */
+static T_DevSto *DevArenaAlloc(uint dpCount, T_DevArena *pArena)
+{
+    pArena->dpVectorOff = DEV_ARENA_ALIGN(sizeof(T_DevSto));
+    pArena->dpValVectorOff = pArena->dpVectorOff + DEV_ARENA_ALIGN(dpCount * sizeof(T_DpSto));
+    pArena->readFlightsOff = pArena->dpValVectorOff + DEV_ARENA_ALIGN(dpCount * sizeof(T_IdiReg));
+    pArena->writeFlightsOff = pArena->readFlightsOff + DEV_ARENA_ALIGN(dpCount * sizeof(T_IdiReadFlight));
+    pArena->snapSlotsOff = pArena->writeFlightsOff + DEV_ARENA_ALIGN(dpCount * sizeof(T_IdiWriteFlight));
+    pArena->regCodecsOff = pArena->snapSlotsOff + DEV_ARENA_ALIGN(dpCount * sizeof(uint32_t));
+#ifdef IDI_USE_COROUTINES
+    pArena->regEventsOff = pArena->regCodecsOff + DEV_ARENA_ALIGN(dpCount * sizeof(const T_IdiCodec *));
+    pArena->size = DEV_ARENA_ALIGN(pArena->regEventsOff + dpCount * sizeof(T_IdiCoEvent));
+#else
+    pArena->size = DEV_ARENA_ALIGN(pArena->regCodecsOff + dpCount * sizeof(const T_IdiCodec *));
+#endif
+    pArena->pPool = DevArenaPoolOf(pArena->size);
+    pArena->pBase = pArena->pPool ? (char *)IdiChunkPoolAlloc(pArena->pPool) : NULL;
+    if (pArena->pBase == NULL) {
+        pArena->pPool = NULL;
+        pArena->pBase = (char *)calloc(1, pArena->size);
+    }
+
+    return (T_DevSto *)pArena->pBase;
+}
+
+
 /* DevSetCustomIdiDevData: a utility function to add device specific allocated storage */
 /* and set the per device's idiDevData to NULL.                                        */
 static int DevSetCustomIdiDevData(IdlDev *dev)
@@ -253,7 +444,7 @@ static int DevSetCustomIdiDevData(IdlDev *dev)
     uint dpCount = 0;
 
     int idlError = IErr_Success;
-    if (gDrvInfo.deviceEntry < CDDEVLIMIT) {
+    if (gDrvInfo.deviceEntry < gIdiConf.devMaxCount) {
         if (!dev->idiDevData) {
             // get the device's total datapoint count
             IdlInterfaceBlock *ifblock = dev->firstIfblock;
@@ -266,136 +457,137 @@ static int DevSetCustomIdiDevData(IdlDev *dev)
                 ifblock = ifblock->next;
             }
 
-            // allocate per device DevStorage structure
-            T_DevSto *pLocDevStorageStruc = (T_DevSto *)calloc(1, sizeof(T_DevSto));
+            // allocate the per device arena: DevStorage structure followed by the datapoint
+            // structure vector, the datapoint value vector and the read/write flights
+            T_DevArena arena;
+            T_DevSto *pLocDevStorageStruc = DevArenaAlloc(dpCount, &arena);
             if (pLocDevStorageStruc) {
-                // dbg_printf("%s: allocated per device DevStorage structure (%p)for local storage\n", __FUNCTION__, pLocDevStorageStruc);
-                // allocate per device device datapoint structure vector for local storage 
-                T_DpStoVector pDevDpVector = (T_DpStoVector)calloc(dpCount, sizeof(T_DpSto));
-                if (pDevDpVector) {
-                    // dbg_printf("%s: allocated per device datapoint structure vector (%p)for local storage\n", __FUNCTION__, pDevDpVector);
-                    pLocDevStorageStruc->pDevDpVector = pDevDpVector;         // point to the allocated storage
-
-                    // allocate per device device datapoint value vector for local storage 
-                    T_DataPoint *pDevDpValVector = (T_DataPoint *)calloc(dpCount, sizeof(T_DataPoint));
-                    if (pDevDpValVector) {
-                        // dbg_printf("%s: allocated per device datapoint value vector (%p)for local storage\n", __FUNCTION__, pDevDpValVector);
-                        pLocDevStorageStruc->devDpCounts = dpCount;
-                        pLocDevStorageStruc->pDevDpValVector = pDevDpValVector; // point to the allocated storage
-
-                        T_DevNodePtr pNewNode = (T_DevNodePtr)calloc(1, sizeof(T_DevNode));
-                        if (pNewNode) {
-                            pNewNode->pDevSto = pLocDevStorageStruc;
-                            // insert to the end of the list
-                            if (gDrvInfo.pHeadDevNode == NULL) {
-                                pNewNode->pNext = pNewNode->pPrevious = pNewNode;
-                                gDrvInfo.pHeadDevNode = pNewNode;
-                            } else {
-                                pNewNode->pNext     = gDrvInfo.pHeadDevNode;
-                                pNewNode->pPrevious = gDrvInfo.pHeadDevNode->pPrevious;
-                                gDrvInfo.pHeadDevNode->pPrevious->pNext = pNewNode;
-                                gDrvInfo.pHeadDevNode->pPrevious = pNewNode;
-                            }
-                            pNewNode->pDevSto->pDrvInfo = &gDrvInfo;
-                        }
-                        // set idiDevData to the per device DevStorage Structure & increment device count
-                        dev->idiDevData = (void *)pLocDevStorageStruc;          // point to the allocated storage
-                        if (dev->unid) {
-                            strncpy(pLocDevStorageStruc->devUid, dev->unid, sizeof(pLocDevStorageStruc->devUid));
-                            pLocDevStorageStruc->devUid[MAX_UNID_CHARS] = '\0'; // forced string termination
-                        }
-                        gDrvInfo.deviceEntry++;
-                        idlError = IErr_Success;
-                    } else {
-                        err_printf("ERROR: %s- failed to allocate per device's dp value vector for local storage\n", __FUNCTION__);
-                    }
-                } else {
-                    err_printf("ERROR: %s- failed to allocate per device's dp structure vector for local storage\n", __FUNCTION__);
+                // dbg_printf("%s: allocated per device arena (%p) of %zu bytes for local storage\n", __FUNCTION__, pLocDevStorageStruc, arena.size);
+                pLocDevStorageStruc->pDevDpVector = (T_DpStoVector)(arena.pBase + arena.dpVectorOff);
+                pLocDevStorageStruc->pDevDpValVector = (T_DpValVector)(arena.pBase + arena.dpValVectorOff);
+                pLocDevStorageStruc->pReadFlights = (T_IdiReadFlight *)(arena.pBase + arena.readFlightsOff);
+                pLocDevStorageStruc->pWriteFlights = (T_IdiWriteFlight *)(arena.pBase + arena.writeFlightsOff);
+                pLocDevStorageStruc->pSnapSlots = (uint32_t *)(arena.pBase + arena.snapSlotsOff);
+                pLocDevStorageStruc->ppRegCodecs = (const T_IdiCodec **)(arena.pBase + arena.regCodecsOff);
+#ifdef IDI_USE_COROUTINES
+                pLocDevStorageStruc->pRegEvents = (T_IdiCoEvent *)(arena.pBase + arena.regEventsOff);
+#endif
+                for (uint i = 0; i < dpCount; i++) {
+                    pLocDevStorageStruc->pSnapSlots[i] = IDI_SNAP_NONE;   // attached with the datapoints
+#ifdef IDI_USE_COROUTINES
+                    IdiCoEventInit(&pLocDevStorageStruc->pRegEvents[i]);
+#endif
+                }
+                pLocDevStorageStruc->devDpCounts = dpCount;
+                pLocDevStorageStruc->pArenaPool = arena.pPool;
+                pthread_mutex_init(&pLocDevStorageStruc->flightLock, NULL);
+                pLocDevStorageStruc->refs.store(1, std::memory_order_relaxed);
+
+                pLocDevStorageStruc->pDrvInfo = &gDrvInfo;
+                // set idiDevData to the per device DevStorage Structure & increment device count
+                __atomic_store_n(&dev->idiDevData, (void *)pLocDevStorageStruc, __ATOMIC_RELEASE);
+                if (dev->unid) {
+                    strncpy(pLocDevStorageStruc->devUid, dev->unid, sizeof(pLocDevStorageStruc->devUid));
+                    pLocDevStorageStruc->devUid[MAX_UNID_CHARS] = '\0'; // forced string termination
                 }
+                pLocDevStorageStruc->snapKey = IdiSnapKey(pLocDevStorageStruc->devUid);
+                // make it known to the ETI event handler under its unid
+                if (IdiIndexInsert(&gDrvInfo.devIndex, pLocDevStorageStruc) != SUCCESS) {
+                    err_printf("ERROR: %s- failed to index device with unid=%s, its events are ignored\n", 
+                                __FUNCTION__, pLocDevStorageStruc->devUid);
+                }
+                gDrvInfo.deviceEntry++;
+                idlError = IErr_Success;
             } else {
-                    err_printf("ERROR: %s- failed to allocate per device DevStorage structure for local storage\n", __FUNCTION__);
+                err_printf("ERROR: %s- failed to allocate the per device arena of %zu bytes for local storage\n", 
+                            __FUNCTION__, arena.size);
             }
         } else {
             err_printf("ERROR: %s- Can't set custom_idiDevData, it has already been set!", __FUNCTION__);
         }
     } else {
-        err_printf("ERROR: %s- device count exceeded precompiled max number (%d) defined in device idl configuration\n", 
-                    __FUNCTION__, CDDEVLIMIT);
+        err_printf("ERROR: %s- device count exceeded the device max count (%u) of the idl configuration\n", 
+                    __FUNCTION__, gIdiConf.devMaxCount);
     }
 
     return idlError;
 }
 
 
+/* DevArenaFree: free a device's arena and what its registers keep out of line;  */
+/* called once the epoch reclamation knows nobody can use it any more            */
+static void DevArenaFree(void *pArena)
+{
+    T__DevStoPtr pDevSto = (T__DevStoPtr)pArena;
+
+    for (uint i = 0; i < pDevSto->devDpCounts; i++) {
+        IdiRegFree(&pDevSto->pDevDpValVector[i]);
+    }
+    pthread_mutex_destroy(&pDevSto->flightLock);
+    dbg_printf("\n %s: deallocate per device arena (%p)for local storage\n", __FUNCTION__, pArena);
+    if (pDevSto->pArenaPool) {
+        IdiChunkPoolRelease(pDevSto->pArenaPool, pArena);
+    } else {
+        free(pArena);
+    }
+}
+
+
+/* DevStoHold: take a reference on the device storage of dev for a datapoint action, */
+/* NULL if the device has none or is being deleted.  May be called from any thread.  */
+static T__DevStoPtr DevStoHold(IdlDev *dev)
+{
+    T__DevStoPtr pDevSto;
+
+    // the section keeps the arena from being reclaimed between the load and the increment
+    IdiEbrEnter();
+    pDevSto = (T__DevStoPtr)__atomic_load_n(&dev->idiDevData, __ATOMIC_ACQUIRE);
+    if (pDevSto) {
+        int refs = pDevSto->refs.load(std::memory_order_relaxed);
+        while (refs > 0 && !pDevSto->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire)) {
+        }
+        if (refs <= 0) {
+            pDevSto = NULL;
+        }
+    }
+    IdiEbrExit();
+
+    return pDevSto;
+}
+
+
+/* DevStoRelease: drop a reference; the last one hands the arena to the epoch */
+/* reclamation so that ETI event handlers still looking at it finish first    */
+static void DevStoRelease(T__DevStoPtr pDevSto)
+{
+    if (pDevSto && pDevSto->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        IdiEbrRetire(pDevSto, DevArenaFree);
+    }
+}
+
+
 /* DevRemoveCustomIdiDevData: a utility function to remove device specific allocated storage */
-/* and set the per device's idiDevData to NULL.                                              */
+/* and set the per device's idiDevData to NULL.  The executor only runs a delete once the    */
+/* datapoint actions queued for the device before it are done (IdiExecBarrierPassed).        */
 static int DevRemoveCustomIdiDevData(IdlDev *dev)
 {
     int idlError = IErr_Failure;
 
     if (dev->idiDevData) {
-        // deallocate per device DeviceStorageStruc, dp storage vector, dp value storage vector & 
-        // update gDrvInfo.pHeadDevNode list
-        // we assume this routine is called within the fsm in threadsafe manner
-        T_DevNodePtr pCurNode = gDrvInfo.pHeadDevNode;
-        dbg_printf("\n%s: pCurNode = pHeadDevNode (%p)for local storage\n", __FUNCTION__, pCurNode);
-        while (pCurNode) {
-            dbg_printf("\n%s: processing pCurNode(%p) with name=%s\n", __FUNCTION__, pCurNode, pCurNode->pDevSto->devUid);
-            if (pCurNode->pDevSto == (T__DevStoPtr)dev->idiDevData) {
-                // we found the device storage node
-                dbg_printf("\n%s: Dev->name:%s pCurNode(%p) pCurNode->pDevSto(%p) == dev->idiDevData\n", __FUNCTION__, 
-                                 dev->info.name, pCurNode, pCurNode->pDevSto);
-                if (pCurNode == gDrvInfo.pHeadDevNode) {
-                    // we are removing the head node
-                    dbg_printf("\n%s: pCurNode == pHeadDevNode(%p) => removing from head\n", __FUNCTION__, gDrvInfo.pHeadDevNode);
-                    if (pCurNode->pNext == pCurNode) {
-                        // we are removing the only node
-                        gDrvInfo.pHeadDevNode = NULL;
-                        dbg_printf("\n%s: pCurNode->pNext == pCurNode(%p) => removing the only node\n", __FUNCTION__, pCurNode->pNext);
-                    } else {
-                        // we are moving the head to the next node
-                        gDrvInfo.pHeadDevNode = pCurNode->pNext;
-                        dbg_printf("\n%s: => moving  head to next node; gDrvInfo.pHeadDevNode = pCurNode->pNext(%p)\n", 
-                                    __FUNCTION__, pCurNode->pNext);
-                        pCurNode->pPrevious->pNext = pCurNode->pNext;
-                        dbg_printf("\n%s: pCurNode->pPrevious->pNext = pCurNode->pNext;(%p)\n", __FUNCTION__, pCurNode->pNext);
-                        pCurNode->pNext->pPrevious = pCurNode->pPrevious;
-                        dbg_printf("\n%s: pCurNode->pNext->pPrevious = pCurNode->pPrevious;(%p)\n", __FUNCTION__, pCurNode->pPrevious);
-                    }
-                } else {
-                    dbg_printf("\n %s: Dev->name:%s pCurNode(%p) pCurNode != pHeadDevNode(%p) => removing from somewhere in list\n", 
-                                __FUNCTION__, dev->info.name, pCurNode, gDrvInfo.pHeadDevNode);
-                    pCurNode->pPrevious->pNext = pCurNode->pNext;
-                    dbg_printf("\n %s: pCurNode->pPrevious->pNext = pCurNode->pNext;(%p)\n", __FUNCTION__, pCurNode->pNext);
-                    pCurNode->pNext->pPrevious = pCurNode->pPrevious;
-                    dbg_printf("\n %s: pCurNode->pNext->pPrevious = pCurNode->pPrevious;(%p)\n", __FUNCTION__, pCurNode->pPrevious);
-                }
-
-                dbg_printf("\n %s: deallocate per device datapoint structure vector  (%p)for local storage\n", __FUNCTION__, 
-                            pCurNode->pDevSto->pDevDpVector);
-                IdlMemFree( pCurNode->pDevSto->pDevDpVector );
-                dbg_printf("\n %s: deallocate per device datapoint value vector (%p)for local storage\n", __FUNCTION__, 
-                            pCurNode->pDevSto->pDevDpValVector );
-                IdlMemFree( pCurNode->pDevSto->pDevDpValVector );
-                dbg_printf("\n %s: deallocate per device DevStorage structure (%p)for local storage\n", __FUNCTION__, 
-                            (dev->idiDevData));
-                IdlMemFree( (dev->idiDevData));
-                dbg_printf("\n %s: Freeing pCurNode(%p)\n", __FUNCTION__, pCurNode);
-                IdlMemFree(pCurNode);   // free the device storage node
-                dev->idiDevData = NULL;
-                gDrvInfo.deviceEntry--;
-
-                idlError = IErr_Success;
-                break;  // we are done
-            }
-            pCurNode = pCurNode->pNext;
-            dbg_printf("\n %s: pCurNode = pCurNode->pNext;(%p)\n", __FUNCTION__, pCurNode);
-            if (pCurNode == gDrvInfo.pHeadDevNode) {
-                dbg_printf("\n %s: Done - Unable to find the entry in gDrvInfo.pHeadDevNode list to clear custom_idiDevData!", 
-                            __FUNCTION__);
-                break;  // we have exhausted the search
-            }
+        T__DevStoPtr pDevSto = (T__DevStoPtr)dev->idiDevData;
+        dbg_printf("\n%s: Dev->name:%s removing pDevSto(%p) with unid=%s from the device index\n", __FUNCTION__, 
+                    dev->info.name, pDevSto, pDevSto->devUid);
+        // ETI event handlers can not find it any more, those that already did are in an epoch section
+        IdiIndexRemove(&gDrvInfo.devIndex, pDevSto);
+        for (uint i = 0; i < pDevSto->devDpCounts; i++) {
+            IdiSnapDetach(pDevSto->pSnapSlots[i]);
         }
+        pDevSto->bDeleted.store(true, std::memory_order_release);
+        __atomic_store_n(&dev->idiDevData, (void *)NULL, __ATOMIC_RELEASE);
+        gDrvInfo.deviceEntry--;
+        DevStoRelease(pDevSto);
+
+        idlError = IErr_Success;
         dbg_printf("\n %s: done. idlError=%d\n", __FUNCTION__, idlError);
     } else {
         err_printf("ERROR: %s- Can't clear custom_idiDevData, it has not been set!", __FUNCTION__);
@@ -405,6 +597,142 @@ static int DevRemoveCustomIdiDevData(IdlDev *dev)
 }
 
 
+/* IdiPostRead: queue a read, or attach it to the queued read of the same device */
+/* register so that one device operation answers both                           */
+static int IdiPostRead(IdiActionCB& aCB)
+{
+    T__DevStoPtr pDevEntry = DevStoHold(aCB.dev);
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiReadFlight *pFlight;
+    T_IdiReadWaiter *pWaiter;
+    int rc;
+
+    // the action keeps the device storage alive until its result is reported
+    aCB.pDevSto = pDevEntry;
+    if (pDevEntry == NULL || pDevEntry->pReadFlights == NULL || pDpStruc == NULL || 
+            pDpStruc->address >= pDevEntry->devDpCounts) {
+        rc = IdiExecPost(aCB);
+        if (rc != SUCCESS) {
+            DevStoRelease(pDevEntry);
+        }
+        return rc;
+    }
+    pFlight = &pDevEntry->pReadFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    if (pFlight->bQueued && (pWaiter = (T_IdiReadWaiter *)IdiPoolAlloc(&gReadWaiterPool)) != NULL) {
+        pWaiter->ReqIndex = aCB.ReqIndex;
+        pWaiter->dp = aCB.dp;
+        pWaiter->context = aCB.context;
+        pWaiter->deadlineMs = IdiNowMs() + aCB.timeout;
+        pWaiter->pNext = NULL;
+        if (pFlight->pWaitTail) {
+            pFlight->pWaitTail->pNext = pWaiter;
+        } else {
+            pFlight->pWaitHead = pWaiter;
+        }
+        pFlight->pWaitTail = pWaiter;
+        pthread_mutex_unlock(&pDevEntry->flightLock);
+        // answered by the queued read, which holds the device storage
+        DevStoRelease(pDevEntry);
+        return SUCCESS;
+    }
+    // no read queued, or no waiter left: this read goes to the device itself
+    rc = IdiExecPost(aCB);
+    if (rc == SUCCESS) {
+        pFlight->bQueued = true;
+    }
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+    if (rc != SUCCESS) {
+        DevStoRelease(pDevEntry);
+    }
+
+    return rc;
+}
+
+
+/* IdiReadDetach: called when a read reaches the device; returns the reads that */
+/* joined it.  Reads posted afterwards start a new flight.                      */
+static T_IdiReadWaiter *IdiReadDetach(IdiActionCB& aCB)
+{
+    T__DevStoPtr pDevEntry = aCB.pDevSto;
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiReadFlight *pFlight;
+    T_IdiReadWaiter *pWaiters;
+
+    if (pDevEntry == NULL || pDevEntry->pReadFlights == NULL || pDpStruc == NULL || 
+            pDpStruc->address >= pDevEntry->devDpCounts) {
+        return NULL;
+    }
+    pFlight = &pDevEntry->pReadFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    pWaiters = pFlight->pWaitHead;
+    pFlight->pWaitHead = pFlight->pWaitTail = NULL;
+    pFlight->bQueued = false;
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+
+    return pWaiters;
+}
+
+
+/* IdiReadExpire: called when a read expired before reaching the device; returns */
+/* the reads that joined it and are past their own deadline as well.  The oldest */
+/* of the others is posted as the flight's new read, the rest stay joined to it. */
+static T_IdiReadWaiter *IdiReadExpire(IdiActionCB& aCB)
+{
+    T__DevStoPtr pDevEntry = aCB.pDevSto;
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiReadFlight *pFlight;
+    T_IdiReadWaiter *pExpired = NULL, **ppExpiredTail = &pExpired;
+    T_IdiReadWaiter *pLive = NULL, **ppLiveTail = &pLive, *pLiveLast = NULL;
+    uint64_t now = IdiNowMs();
+
+    if (pDevEntry == NULL || pDevEntry->pReadFlights == NULL || pDpStruc == NULL || 
+            pDpStruc->address >= pDevEntry->devDpCounts) {
+        return NULL;
+    }
+    bool bDeleted = pDevEntry->bDeleted.load(std::memory_order_acquire);
+    pFlight = &pDevEntry->pReadFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    for (T_IdiReadWaiter *pWaiter = pFlight->pWaitHead, *pNext; pWaiter; pWaiter = pNext) {
+        pNext = pWaiter->pNext;
+        pWaiter->pNext = NULL;
+        if (bDeleted || pWaiter->deadlineMs <= now) {
+            *ppExpiredTail = pWaiter;
+            ppExpiredTail = &pWaiter->pNext;
+        } else {
+            *ppLiveTail = pWaiter;
+            ppLiveTail = &pWaiter->pNext;
+            pLiveLast = pWaiter;
+        }
+    }
+    pFlight->pWaitHead = pFlight->pWaitTail = NULL;
+    pFlight->bQueued = false;
+    if (pLive) {
+        IdiActionCB rCB = aCB;
+        rCB.ReqIndex = pLive->ReqIndex;
+        rCB.dp = pLive->dp;
+        rCB.context = pLive->context;
+        rCB.timeout = (uint)(pLive->deadlineMs - now);
+        rCB.args = NULL;
+        rCB.lastError = IErr_Success;
+        // the new read holds the device storage too; the expired one holds it until reported
+        pDevEntry->refs.fetch_add(1, std::memory_order_relaxed);
+        if (IdiExecPost(rCB) == SUCCESS) {
+            pFlight->bQueued = true;
+            pFlight->pWaitHead = pLive->pNext;
+            pFlight->pWaitTail = pLive->pNext ? pLiveLast : NULL;
+            IdiPoolRelease(&gReadWaiterPool, pLive);
+        } else {
+            pDevEntry->refs.fetch_sub(1, std::memory_order_relaxed);
+            *ppExpiredTail = pLive;
+        }
+    }
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+
+    return pExpired;
+}
+
+
 /* OnDpReadCb: Callback function registered with the IDL Library which triggers */
 /* when a regular (of type native double) data point read occurs.               */
 int OnDpReadCb(int request_index, IdlDev *dev, IdlDatapoint *dp, void *context)
@@ -430,9 +758,9 @@ int OnDpReadCb(int request_index, IdlDev *dev, IdlDatapoint *dp, void *context)
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
     aCB.dp = dp;
-    aCB.timeout = IDI_ACTION_NORMAL_TIMEOUT;
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
     aCB.context = context;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    if (IdiPostRead(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDpread to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -467,9 +795,9 @@ int OnDpReadExCb(int request_index, IdlDev *dev, IdlDatapoint *dp, void *context
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
     aCB.dp = dp;
-    aCB.timeout = IDI_ACTION_NORMAL_TIMEOUT;
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
     aCB.context = context;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    if (IdiPostRead(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDpread to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -478,6 +806,173 @@ int OnDpReadExCb(int request_index, IdlDev *dev, IdlDatapoint *dp, void *context
 }
 
 
+/* IdiPostWrite: queue a write.  If a write of the same device register is still */
+/* queued and the dp allows it, the new value supersedes the queued one instead: */
+/* the queued write applies the newest value and answers every request.         */
+static int IdiPostWrite(IdiActionCB& aCB)
+{
+    T__DevStoPtr pDevEntry = DevStoHold(aCB.dev);
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiWriteFlight *pFlight;
+    T_IdiWriteWaiter *pWaiter;
+    int rc;
+
+    // the action keeps the device storage alive until its result is reported
+    aCB.pDevSto = pDevEntry;
+    if (pDevEntry == NULL || pDevEntry->pWriteFlights == NULL || pDpStruc == NULL || 
+            !pDpStruc->bCollapseWrites || pDpStruc->address >= pDevEntry->devDpCounts) {
+        rc = IdiExecPost(aCB);
+        if (rc != SUCCESS) {
+            DevStoRelease(pDevEntry);
+        }
+        return rc;
+    }
+    pFlight = &pDevEntry->pWriteFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    if (pFlight->bQueued && (pWaiter = (T_IdiWriteWaiter *)IdiPoolAlloc(&gWriteWaiterPool)) != NULL) {
+        pWaiter->ReqIndex = aCB.ReqIndex;
+        pWaiter->dp = aCB.dp;
+        pWaiter->prio = aCB.prio;
+        pWaiter->relinquish = aCB.relinquish;
+        pWaiter->dValue = aCB.dValue;
+        pWaiter->rawStringValue = aCB.rawStringValue;
+        pWaiter->deadlineMs = IdiNowMs() + aCB.timeout;
+        pWaiter->pNext = NULL;
+        if (pFlight->pWaitTail) {
+            pFlight->pWaitTail->pNext = pWaiter;
+        } else {
+            pFlight->pWaitHead = pWaiter;
+        }
+        pFlight->pWaitTail = pWaiter;
+        pthread_mutex_unlock(&pDevEntry->flightLock);
+        // applied by the queued write, which holds the device storage
+        DevStoRelease(pDevEntry);
+        return SUCCESS;
+    }
+    rc = IdiExecPost(aCB);
+    if (rc == SUCCESS) {
+        pFlight->bQueued = true;
+    }
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+    if (rc != SUCCESS) {
+        DevStoRelease(pDevEntry);
+    }
+
+    return rc;
+}
+
+
+/* IdiWriteDetach: called when a write reaches the device; returns the writes that */
+/* superseded it and sets *pNewest to aCB carrying the newest value.               */
+static T_IdiWriteWaiter *IdiWriteDetach(IdiActionCB& aCB, IdiActionCB *pNewest)
+{
+    T__DevStoPtr pDevEntry = aCB.pDevSto;
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiWriteFlight *pFlight;
+    T_IdiWriteWaiter *pWaiters;
+
+    if (pNewest) {
+        *pNewest = aCB;
+    }
+    if (pDevEntry == NULL || pDevEntry->pWriteFlights == NULL || pDpStruc == NULL || 
+            !pDpStruc->bCollapseWrites || pDpStruc->address >= pDevEntry->devDpCounts) {
+        return NULL;
+    }
+    pFlight = &pDevEntry->pWriteFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    pWaiters = pFlight->pWaitHead;
+    if (pNewest && pFlight->pWaitTail) {
+        pNewest->dp = pFlight->pWaitTail->dp;
+        pNewest->prio = pFlight->pWaitTail->prio;
+        pNewest->relinquish = pFlight->pWaitTail->relinquish;
+        pNewest->dValue = pFlight->pWaitTail->dValue;
+        pNewest->rawStringValue = pFlight->pWaitTail->rawStringValue;
+    }
+    pFlight->pWaitHead = pFlight->pWaitTail = NULL;
+    pFlight->bQueued = false;
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+
+    return pWaiters;
+}
+
+
+/* IdiWriteExpire: called when a write expired before reaching the device; returns */
+/* the writes it superseded that are past their own deadline as well.  The newest  */
+/* value of the others is posted as a new write answering the oldest of them, the  */
+/* rest stay collapsed into it.                                                    */
+static T_IdiWriteWaiter *IdiWriteExpire(IdiActionCB& aCB)
+{
+    T__DevStoPtr pDevEntry = aCB.pDevSto;
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    T_IdiWriteFlight *pFlight;
+    T_IdiWriteWaiter *pExpired = NULL, **ppExpiredTail = &pExpired;
+    T_IdiWriteWaiter *pLive = NULL, **ppLiveTail = &pLive, *pLiveLast = NULL;
+    uint64_t now = IdiNowMs();
+
+    if (pDevEntry == NULL || pDevEntry->pWriteFlights == NULL || pDpStruc == NULL || 
+            !pDpStruc->bCollapseWrites || pDpStruc->address >= pDevEntry->devDpCounts) {
+        return NULL;
+    }
+    bool bDeleted = pDevEntry->bDeleted.load(std::memory_order_acquire);
+    pFlight = &pDevEntry->pWriteFlights[pDpStruc->address];
+    pthread_mutex_lock(&pDevEntry->flightLock);
+    for (T_IdiWriteWaiter *pWaiter = pFlight->pWaitHead, *pNext; pWaiter; pWaiter = pNext) {
+        pNext = pWaiter->pNext;
+        pWaiter->pNext = NULL;
+        if (bDeleted || pWaiter->deadlineMs <= now) {
+            *ppExpiredTail = pWaiter;
+            ppExpiredTail = &pWaiter->pNext;
+        } else {
+            *ppLiveTail = pWaiter;
+            ppLiveTail = &pWaiter->pNext;
+            pLiveLast = pWaiter;
+        }
+    }
+    pFlight->pWaitHead = pFlight->pWaitTail = NULL;
+    pFlight->bQueued = false;
+    if (pLive) {
+        IdiActionCB wCB = aCB;
+        wCB.ReqIndex = pLive->ReqIndex;
+        wCB.dp = pLive->dp;
+        wCB.prio = pLiveLast->prio;
+        wCB.relinquish = pLiveLast->relinquish;
+        wCB.dValue = pLiveLast->dValue;
+        wCB.rawStringValue = pLiveLast->rawStringValue;
+        wCB.timeout = (uint)(pLive->deadlineMs - now);
+        wCB.args = NULL;
+        wCB.lastError = IErr_Success;
+        // the new write holds the device storage too; the expired one holds it until reported
+        pDevEntry->refs.fetch_add(1, std::memory_order_relaxed);
+        if (IdiExecPost(wCB) == SUCCESS) {
+            pFlight->bQueued = true;
+            pFlight->pWaitHead = pLive->pNext;
+            pFlight->pWaitTail = pLive->pNext ? pLiveLast : NULL;
+            IdiPoolRelease(&gWriteWaiterPool, pLive);
+        } else {
+            pDevEntry->refs.fetch_sub(1, std::memory_order_relaxed);
+            *ppExpiredTail = pLive;
+        }
+    }
+    pthread_mutex_unlock(&pDevEntry->flightLock);
+
+    return pExpired;
+}
+
+
+/* IdiWriteReport: send the write result to aCB and to every write it superseded */
+static void IdiWriteReport(IdiActionCB& aCB, T_IdiWriteWaiter *pWaiters, int idlError)
+{
+    IdlDpWriteResult(aCB.ReqIndex, aCB.dev, aCB.dp, idlError);
+    while (pWaiters) {
+        T_IdiWriteWaiter *pWaiter = pWaiters;
+        pWaiters = pWaiter->pNext;
+        IdlDpWriteResult(pWaiter->ReqIndex, aCB.dev, pWaiter->dp, idlError);
+        IdiPoolRelease(&gWriteWaiterPool, pWaiter);
+    }
+    DevStoRelease(aCB.pDevSto);
+}
+
+
 /* OnDpWriteCb: Callback function registered with the IDL Library which triggers */
 /* when a regular (of type native double) data point write occurs.               */
 int OnDpWriteCb(int request_index, IdlDev *dev, IdlDatapoint *dp, int prio, int relinquish, double value)
@@ -507,8 +1002,8 @@ int OnDpWriteCb(int request_index, IdlDev *dev, IdlDatapoint *dp, int prio, int
     aCB.prio = prio;
     aCB.relinquish = relinquish;
     aCB.dValue = value;
-    aCB.timeout = IDI_ACTION_NORMAL_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiPostWrite(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDpwrite to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -547,8 +1042,8 @@ int OnDpWriteExCb(int request_index, IdlDev *dev, IdlDatapoint *dp, int prio,
     aCB.prio = prio;
     aCB.relinquish = relinquish;
     aCB.rawStringValue = value;
-    aCB.timeout = IDI_ACTION_NORMAL_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiPostWrite(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDpwrite to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -623,8 +1118,8 @@ int OnDpCreateCb(int  request_index, IdlDev *dev, IdlDatapoint *dp, char *cpUnre
     aCB.dev = dev;
     aCB.dp = dp;
     aCB.cpUnrecogCols = cpUnrecogCols;
-    aCB.timeout = IDI_ACTION_NORMAL_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDpCreate to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -667,8 +1162,8 @@ int OnDevCreateCb(int request_index, IdlDev *dev, char *args, char *xif_dp_array
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
     aCB.args = args;
-    aCB.timeout = IDI_ACTION_LONG_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaCreate to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -711,8 +1206,8 @@ int OnDevProvisionCb(int request_index, IdlDev *dev, char *args)
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
     aCB.args = args;
-    aCB.timeout = IDI_ACTION_LONG_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaProvision to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -754,8 +1249,8 @@ int OnDevDeprovisionCb(int request_index, IdlDev *dev)
     aCB.action = IdiaDeprovision;
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
-    aCB.timeout = IDI_ACTION_LONG_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDeprovision to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -798,8 +1293,8 @@ int OnDevReplaceCb(int request_index, IdlDev *dev, char *args)
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
     aCB.args = args;
-    aCB.timeout = IDI_ACTION_LONG_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaReplace to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -839,8 +1334,8 @@ int OnDevDeleteCb(int request_index, IdlDev *dev)
     aCB.action = IdiaDelete;
     aCB.ReqIndex = request_index;
     aCB.dev = dev;
-    aCB.timeout = IDI_ACTION_LONG_TIMEOUT;
-    if (mq_send(gDrvInfo.idiDevActQueue, (const char *)&aCB, sizeof(IdiActionCB), 1) != 0) {    
+    aCB.timeout = IdiConfDeadlineMs(&gIdiConf, aCB.action);
+    if (IdiExecPost(aCB) != SUCCESS) {    
         err_printf("WARN: %s- Failed to send IdiaDelete to idiDevActQueue, err=%d\n", __FUNCTION__, errno);
         idlError = IErr_IdiBusy;
     }
@@ -876,137 +1371,81 @@ uint RandomInteger(uint n) {
 }
 
 
-/* ConvertDoubleToJson: a function taken directly from Idl library to convert double  */
-/* value to cJSON object.  The conversion include conversion of enum to cJSON string  */
-static cJSON *ConvertDoubleToJson(IdlDatapoint *dp, double value)
+/* GenerateDpDefVal: a function taken directly from Idl library to set the default */
+/* value of a datapoint                                                             */
+static void GenerateDpDefVal(IdlDatapoint *dp, const T_DpSto *pDpStruc, T_DataPoint *pDpVal)
 {
-    int i = 0;
-    cJSON *dpValue = NULL;
-    if (dp) {
-        if (dp->info.iapEnum.enumMap) {
-            for (i = 0; i < dp->info.iapEnum.count; i++) {
-                if (value == dp->info.iapEnum.enumMap[i].value) {
-                    dpValue = cJSON_CreateString(dp->info.iapEnum.enumMap[i].enumStr);
-                    break;
-                }
-            }
-            if (i == dp->info.iapEnum.count) {
-                dpValue = cJSON_CreateNull();
-            }
+    if (dp->info.dflt.isDefaultValid) {
+        if (dp->info.isTypeAscii) {
+            IdiValSetString(pDpVal, dp->info.dflt.stringValue);
+        } else if (dp->info.isTypeNative) {
+            IdiCodecParse(pDpStruc->pCodec, pDpVal, dp->info.dflt.nativeValue);
         } else {
-            dpValue = cJSON_CreateNumber(value);
+            IdiXformWrite(&pDpStruc->xform, dp->info.dflt.value, pDpVal);
         }
+    } else {
+        IdiValSetDouble(pDpVal, 0);
     }
-    return dpValue;
 }
 
 
-/* GenerateDpDefVal: a function taken directly from Idl library to return default    */
-/* value in cJSON object.  The conversion include conversion of enum to cJSON string */
-static cJSON *GenerateDpDefVal(IdlDatapoint *dp)
+// SetDpValForLocStorUpdate: a function to set the datapoint value to the actual value
+// being written.
+static void SetDpValForLocStorUpdate(IdiActionCB& aCB, T_DataPoint *pDpVal) 
 {
-    cJSON *dfltJson = NULL;
-    if (dp) {
-        if (dp->info.dflt.isDefaultValid) {
-            if (dp->info.isTypeAscii) {
-                dfltJson = cJSON_CreateString(dp->info.dflt.stringValue);
-            } else if (dp->info.isTypeNative) {
-                dfltJson = IdlStringTocJSON(dp->info.dflt.nativeValue);
-            } else {
-                dfltJson = ConvertDoubleToJson(dp, dp->info.dflt.value);
-            }
-        } else {
-            dfltJson = cJSON_CreateNumber(0);
-        }
-    }
-    return dfltJson;
-}
-
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
 
-// GetDpValForLocStorUpdate: a function to return datapoint's actual value to be written
-// in cJSON object.
-static cJSON *GetDpValForLocStorUpdate(IdiActionCB& aCB) 
-{
-    cJSON *actualValue = NULL;
-    if (aCB.dp) {
-        if (aCB.dp->info.isTypeAscii) {
-            actualValue = cJSON_CreateString(aCB.rawStringValue);
-        } else if (aCB.dp->info.isTypeNative) {
-            actualValue = IdlStringTocJSON(aCB.rawStringValue);
-        } else {
-            actualValue = ConvertDoubleToJson(aCB.dp, aCB.dValue);
-        }
+    if (aCB.dp->info.isTypeAscii) {
+        IdiValSetString(pDpVal, aCB.rawStringValue);
+    } else if (aCB.dp->info.isTypeNative) {
+        IdiCodecParse(pDpStruc->pCodec, pDpVal, aCB.rawStringValue);
+    } else {
+        IdiXformWrite(&pDpStruc->xform, aCB.dValue, pDpVal);
     }
-    return actualValue;
 }
 
 
-#define TYPE_INVALID   1
-#define TYPE_BELOW_MIN 2
-#define TYPE_ABOVE_MAX 3
-
-/* DpValueRangeCheck: a function taken directly from Idl library to check datapoint's  */
-/* value range (valid rangeMin & rangeMax).  If passing a null for the exceptionType   */
-/* or (isRangeMinValid or isRangeMaxValid is true) and value is not out of range, this */
-/* function will return IErr_Success. Otherwise, it will return IErr_Failure           */
-static int DpValueRangeCheck(IdlDatapoint *dp, double value, int *exceptionType)
+// DpValueText: a function to get the JSON text of a datapoint's register value, enum values
+// as their enum string, from the register's cache.  The caller has to be in an IdiEbrEnter
+// section while it uses the text; NULL if the register has no value.
+static const char *DpValueText(const T_DpSto *pDpStruc)
 {
-    int idlError = IErr_Success;
-    if (dp && exceptionType) {
-        if  (dp->info.scale.isRangeMinValid && (value < (double)dp->info.scale.rangeMin)) {
-            *exceptionType = TYPE_BELOW_MIN;
-            idlError = IErr_Failure;
-        } else if (dp->info.scale.isRangeMaxValid && (value > (double)dp->info.scale.rangeMax)) {
-            *exceptionType = TYPE_ABOVE_MAX;
-            idlError = IErr_Failure;
-        }
-    }
-    return idlError;
+    const T_IdiEnumTab *pTab = pDpStruc->xform.pEnumTab;
+    return IdiRegText(pDpStruc->pDpValue, pTab ? pTab->ppStrs : NULL, pTab ? pTab->count : 0);
 }
 
 
-// JsonDpValueToDouble: a function to convert datapoint Json value to a double.  
-// The conversion include conversion of enum string to double */
-static int JsonDpValueToDouble(cJSON *value, IdlDatapoint *dp, double *dValue)
+#ifdef INCLUDE_ETI
+// DpValWrite: a function to print a value of a datapoint as JSON text, enum values as their
+// enum string, into the calling thread's buffer (IdiBufLocal); NULL if it has no value.
+static const char *DpValWrite(const T_DpSto *pDpStruc, const T_IdiVal *pVal)
 {
-    int i = 0;
-    int idlError = IErr_Success;
-    if (dp) {
-        if (cJSON_IsString(value)) {
-            if (strcmp(value->valuestring, INVALID_STR) == 0 && dp->info.scale.isInvalidPresent) {
-                *dValue = dp->info.actualValue;
-                dp->info.writeInvalidToDp = 1;
-            } else if (dp->info.iapEnum.enumMap) {
-                for (i = 0; i < dp->info.iapEnum.count; i++) {
-                    if (strcasecmp(value->valuestring, dp->info.iapEnum.enumMap[i].enumStr) == 0) {
-                        *dValue = dp->info.iapEnum.enumMap[i].value;
-                        break;
-                    }
-                }
-                if (i == dp->info.iapEnum.count) {
-                    *dValue = dp->info.dflt.value; //will be 0 if default is not defined
-                }
-            } else {
-                idlError = IErr_Failure;
-            }
-        } else if (cJSON_IsNumber(value) && DpValueRangeCheck(dp, value->valuedouble, NULL) == IDL_SUCCESS) {
-            *dValue = value->valuedouble;
-        } else {
-            idlError = IErr_Failure;
-        }
-    } else {
-        idlError = IErr_Failure;
+    const T_IdiEnumTab *pTab = pDpStruc->xform.pEnumTab;
+    const char *pEnumStr = NULL;
+
+    if (pVal->type == IdiValEnum && pTab && pVal->enumIdx >= 0 && pVal->enumIdx < pTab->count) {
+        pEnumStr = pTab->ppStrs[pVal->enumIdx];
     }
-    return idlError;
+    return IdiValWrite(pVal, pEnumStr, IdiBufLocal());
 }
+#endif
 
 
 // SetDpValueFromDpLocalStorage: a function to set datapoint actual value (actualStringValue,
-// actualNativeValue, or double)
-static int SetDpValueFromDpLocalStorage(IdiActionCB& aCB, T_DataPoint pcJsonDpVal, double *dValue)
+// actualNativeValue, or double).  The JSON text comes from the register's cache, only the
+// copies handed over to the Idl library are allocated.
+static int SetDpValueFromDpLocalStorage(IdiActionCB& aCB, const T_DpSto *pDpStruc, const T_DataPoint *pDpVal,
+                                        double *dValue)
 {
     int idlError = IErr_Success;
+    const char *pJsonText = NULL;
 
+    if (aCB.dp->info.isTypeAscii || aCB.dp->info.isTypeNative) {
+        pJsonText = DpValueText(pDpStruc);
+        if (pJsonText == NULL) {
+            return IErr_Failure;
+        }
+    }
     if (aCB.dp->info.isTypeAscii) {
         char *pTemp = aCB.dp->info.actualStringValue;
         if (aCB.dp->info.actualStringValue) {
@@ -1016,8 +1455,7 @@ static int SetDpValueFromDpLocalStorage(IdiActionCB& aCB, T_DataPoint pcJsonDpVa
             IdlMemFree(aCB.dp->info.actualStringValue);
         }
         // let actualStringValue be freed by Idl library routine
-        char *strValue = cJSON_PrintUnformatted(pcJsonDpVal);
-        aCB.dp->info.actualStringValue = strValue;
+        aCB.dp->info.actualStringValue = strdup(pJsonText);
         if (aCB.dp->info.rawStringValue && aCB.dp->info.rawStringValue != pTemp) {
             // free the current rawStringValue
             // dbg_printf("%s: isTypeAscii deallocate aCB.dp->info.rawStringValue (%p)\n", 
@@ -1030,7 +1468,7 @@ static int SetDpValueFromDpLocalStorage(IdiActionCB& aCB, T_DataPoint pcJsonDpVa
                     __FUNCTION__, (void *)pTemp, (void *)aCB.dp->info.rawStringValue);
         }
         // let rawStringValue be freed by Idl library routine
-        aCB.dp->info.rawStringValue = strdup(strValue);
+        aCB.dp->info.rawStringValue = strdup(pJsonText);
         // dbg_printf("SetDpValueFromDpLocalStorage: setting actualStringValue=%s\n", aCB.dp->info.actualStringValue);
     } else if (aCB.dp->info.isTypeNative) {
         if (aCB.dp->info.rawStringValue) {
@@ -1040,20 +1478,67 @@ static int SetDpValueFromDpLocalStorage(IdiActionCB& aCB, T_DataPoint pcJsonDpVa
             IdlMemFree(aCB.dp->info.rawStringValue);
         }
         // let rawStringValue be freed by Idl library routine
-        char *strValue = cJSON_PrintUnformatted(pcJsonDpVal);
-        aCB.dp->info.rawStringValue = strValue;
+        aCB.dp->info.rawStringValue = strdup(pJsonText);
         // dbg_printf("%s: isTypeNative new aCB.dp->info.rawStringValue (%p) = %s\n", 
         //         __FUNCTION__, (void *)aCB.dp->info.rawStringValue, aCB.dp->info.rawStringValue);
     } else {
-        idlError = JsonDpValueToDouble(pcJsonDpVal, aCB.dp, dValue);
-        // aCB.dp->info.actualValue = *dValue;
-        // dbg_printf("%s: isTypeDouble setting dValue=%lf\n", __FUNCTION__, *dValue);
+        // enum mapping and TestMultiplier in one go, the Idl library scales the double
+        idlError = IdiXformRead(&pDpStruc->xform, pDpVal, dValue);
+        if (idlError == IDI_XFORM_INVALID) {
+            *dValue = aCB.dp->info.actualValue * pDpStruc->xform.multiplier;
+            aCB.dp->info.writeInvalidToDp = 1;
+            idlError = IErr_Success;
+        }
     }
 
     return idlError;
 }
 
 
+/* IdiReadReport: send the read result to aCB and to every read that joined it; */
+/* the value's text is printed at most once per change of the register          */
+static void IdiReadReport(IdiActionCB& aCB, T_IdiReadWaiter *pWaiters, int idlError)
+{
+    IdiActionCB rCB = aCB;
+
+    for (;;) {
+        T_DpSto *pDpStruc = (T_DpSto *)(rCB.dp->idiDpData);
+        double dpValue = 0;
+        int rc = idlError;
+
+        if (rc == IErr_Success) {
+            T_DataPoint dpVal = {};
+            // the value's out of line parts stay valid until IdiEbrExit
+            IdiEbrEnter();
+            if (pDpStruc) {
+                IdiRegLoad(pDpStruc->pDpValue, &dpVal);
+            }
+            if (dpVal.type != IdiValNone) {
+                rc = SetDpValueFromDpLocalStorage(rCB, pDpStruc, &dpVal, &dpValue);
+                if (rc != IErr_Success) {
+                    err_printf("ERROR: %s- Unable to read dp entry in localDpValuesVector\n", __FUNCTION__);
+                }
+            } else {
+                rc = IErr_Failure;
+            }
+            IdiEbrExit();
+        }
+        IdlDpReadResult(rCB.ReqIndex, rCB.dev, rCB.dp, rCB.context, rc, prio_array, dpValue);
+
+        if (pWaiters == NULL) {
+            break;
+        }
+        T_IdiReadWaiter *pWaiter = pWaiters;
+        pWaiters = pWaiter->pNext;
+        rCB.ReqIndex = pWaiter->ReqIndex;
+        rCB.dp = pWaiter->dp;
+        rCB.context = pWaiter->context;
+        IdiPoolRelease(&gReadWaiterPool, pWaiter);
+    }
+    DevStoRelease(aCB.pDevSto);
+}
+
+
 static int IdiDpProcessCustomColum(IdiActionCB& aCB)
 {
     int idlError = IErr_Success;
@@ -1097,6 +1582,9 @@ static int IdiDpProcessCustomColum(IdiActionCB& aCB)
                 pDpStruct->testMultiplier = 1;  // to prevent multiplying a value by 0
                 err_printf("ERROR: %s- custom column testMultiplier is required for dp.name=%s\n", __FUNCTION__, aCB.dp->name);
             }
+            // reads apply the multiplier as part of the dp's transform
+            IdiXformCompile(&pDpStruct->xform, pDpStruct->xform.pEnumTab, aCB.dp->info.scale.isInvalidPresent, 
+                            aCB.dp->info.dflt.value, pDpStruct->testMultiplier);
         } else {
             err_printf("ERROR: %s- invalid idiDevData for dp.name=%s - initialized in DevSetCustomIdiDevData\n", __FUNCTION__, aCB.dp->name);
         }
@@ -1112,38 +1600,20 @@ static int IdiDpProcessCustomColum(IdiActionCB& aCB)
 /*  to simulate asynchronous processing of any callback routines.    */
 void *ProcAsynThrdFunc(void* pvArg)
 {
-	int retVal = SUCCESS;
-    char qName[Q_NAME_LENGTH];
-    IdiActionCB aCB = {0};
-    
     pthread_setname_np(pthread_self(), __FUNCTION__);       // <= 16 chars
+    // IdiShutdown waits for this thread to leave action shard 0
+    gAsynThread = pthread_self();
+    __atomic_store_n(&gbAsynThread, true, __ATOMIC_RELEASE);
     info_printf("INFO: The " CDNAME " IDI Process Asynchronous Requests driver thread started...\r\n");
 
     srand(time(NULL));   // Initialization, should only be called once.
-    sprintf(qName, IDI_ACT_Q, CDNAME);
-	retVal = IdiCreateQueue(&gDrvInfo.idiDevActQueue, qName, BLOCKING_Q, MQ_HARD_LIM, sizeof(IdiActionCB));
-	if (retVal != SUCCESS) {
-        err_printf("ERROR %s: IdiCreateQueue %s failed\n", __FUNCTION__, qName);
-        exit (EXIT_FAILURE);
-	} else {
-		info_printf("INFO: IdiCreateQueue %s successful\n", qName);
-
-        // service the device action queue here until being told to stop
-        gDrvInfo.stat = IdiRunning;
-        while (gDrvInfo.stat != IdiStop) {
-            retVal = mq_receive(gDrvInfo.idiDevActQueue, (char*)&aCB, sizeof(IdiActionCB), NULL);
-            if(retVal == -1) {
-                continue;
-            }
-
-            IdiBlockWhileBusy(aCB);
-
-            /* clean-up */
-            aCB = {0};
-        }
-
 
-    }
+    // service the device action queues here until being told to stop
+#ifdef IDI_USE_REACTOR
+    IdiReactorRun();
+#else
+    IdiExecRun();
+#endif
 
     return NULL;
 }
@@ -1161,6 +1631,159 @@ bool IsFsmProcessingDone(IdiActionCB& aCB) {
 #endif
 }
 
+/* IdiDpWriteApply: write the newest of the values queued for aCB's register to */
+/* the device and answer every write that was collapsed into it                  */
+static int IdiDpWriteApply(IdiActionCB& aCB)
+{
+    int idlError = IErr_Success;
+    IdiActionCB wCB;
+    T_IdiWriteWaiter *pWaiters = IdiWriteDetach(aCB, &wCB);
+    T_DpSto *pDpStruc = (T_DpSto *)(wCB.dp->idiDpData);
+
+    if (aCB.pDevSto == NULL || aCB.pDevSto->bDeleted.load(std::memory_order_acquire)) {
+        // posted after the device was deleted; its storage is only kept for this report
+        idlError = IErr_Failure;
+        err_printf("ERROR: %s- Write on a deleted device\n", __FUNCTION__);
+    } else if (pDpStruc) {
+        T_DataPoint newVal = {};
+        SetDpValForLocStorUpdate(wCB, &newVal);
+#ifdef INCLUDE_ETI
+        // the device gets this write's value, whatever the register holds by the time it is
+        // published; printed before the store takes newVal over, nothing else on this thread
+        // prints into the buffer until then
+        const char *outStr = DpValWrite(pDpStruc, &newVal);
+#endif
+
+        // update dp entry in in per device's DevDpValue vector and, if it changed, in the snapshot
+        if (IdiRegStore(pDpStruc->pDpValue, &newVal)) {
+            IdiSnapStore(__atomic_load_n(&aCB.pDevSto->pSnapSlots[pDpStruc->address], __ATOMIC_ACQUIRE), 
+                            __atomic_load_n(&aCB.pDevSto->snapKey, __ATOMIC_ACQUIRE), pDpStruc->pDpValue);
+        }
+        dbg_printf(" Value written at pDpStruc(%p)->pDpValue = %p\n", pDpStruc, pDpStruc->pDpValue);
+
+#ifdef INCLUDE_ETI
+        uint reg = pDpStruc->address;
+        idlError = DevWritePublish(aCB.pDevSto, reg, outStr);
+#endif
+    } else {
+        idlError = IErr_Failure;
+        err_printf("ERROR: %s- Write error on unitialized idiDpData\n", __FUNCTION__);
+    }
+    if (aCB.args) {
+        IdiFree(aCB.args);
+    }
+    IdiWriteReport(aCB, pWaiters, idlError);
+
+    return idlError;
+}
+
+
+/* IdiDpReadApply: read aCB's register and answer every read that joined it.  bAsk */
+/* has the device asked for the register first, false if the caller already did.  */
+static int IdiDpReadApply(IdiActionCB& aCB, bool bAsk)
+{
+    int idlError = IErr_Success;
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    // reads of this register posted from now on need a new device operation
+    T_IdiReadWaiter *pWaiters = IdiReadDetach(aCB);
+
+    if (aCB.pDevSto == NULL || aCB.pDevSto->bDeleted.load(std::memory_order_acquire)) {
+        idlError = IErr_Failure;
+        err_printf("ERROR: %s- Read on a deleted device\n", __FUNCTION__);
+    } else if (pDpStruc) {
+#ifdef INCLUDE_ETI
+        if (bAsk) {
+            uint reg = pDpStruc->address;
+            DevReadPublish(aCB.pDevSto, reg);
+        }
+#endif
+        if (!IdiRegHasValue(pDpStruc->pDpValue)) {
+            idlError = IErr_Failure;
+            err_printf("ERROR: %s- No value found for dp entry in localDpValuesVector\n", __FUNCTION__);
+        }
+    } else {
+        idlError = IErr_Failure;
+        err_printf("ERROR: %s- Unitialized idiDpData - device possibly has been deleted!\n", __FUNCTION__);
+    }
+    if (aCB.args) {
+        IdiFree(aCB.args);
+    }
+    IdiReadReport(aCB, pWaiters, idlError);
+
+    return idlError;
+}
+
+
+#ifdef IDI_USE_COROUTINES
+/* IdiCoDevCreate: device creation written as a coroutine flow.  Each co_await */
+/* gives the worker back until the device is ready for the next step.         */
+static IdiTask IdiCoDevCreate(IdiActionCB& aCB)
+{
+    int idlError = IErr_Failure;
+
+    if (aCB.dev && aCB.dev->handle) {
+        while (!IsFsmProcessingDone(aCB)) {
+            co_await IdiCoBusy{};
+        }
+        // allocate per device's storage
+        idlError = DevSetCustomIdiDevData(aCB.dev);
+    } else {
+        err_printf("ERROR: %s- Malformed IdlDev", __FUNCTION__);
+    }
+    if (aCB.args) {
+        IdiFree(aCB.args);
+    }
+    IdlDevCreateResult(aCB.ReqIndex, aCB.dev, idlError);
+
+    co_return idlError;
+}
+
+
+/* IdiCoDpRead: datapoint read written as a coroutine flow.  The device is asked for */
+/* the register and the flow waits for it to be reported over ETI, at most for      */
+/* IDI_READ_ANSWER_MS, before the register's value answers the read.               */
+static IdiTask IdiCoDpRead(IdiActionCB& aCB)
+{
+    while (!IsFsmProcessingDone(aCB)) {
+        co_await IdiCoBusy{};
+    }
+#ifdef INCLUDE_ETI
+    T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
+    if (aCB.pDevSto && !aCB.pDevSto->bDeleted.load(std::memory_order_acquire) && pDpStruc && 
+            pDpStruc->address < aCB.pDevSto->devDpCounts) {
+        // reads joining this one meanwhile get the reported value too, so only this flow
+        // waits on the register's event
+        T_IdiCoEvent *pEvent = &aCB.pDevSto->pRegEvents[pDpStruc->address];
+        uint64_t now = IdiNowMs();
+        uint waitMs = (aCB.exec.deadlineMs > now) ? (uint)((aCB.exec.deadlineMs - now) / 2) : 0;
+        if (waitMs > IDI_READ_ANSWER_MS) {
+            waitMs = IDI_READ_ANSWER_MS;
+        }
+        IdiCoEventReset(pEvent);
+        if (DevReadPublish(aCB.pDevSto, pDpStruc->address) == MOSQ_ERR_SUCCESS && waitMs) {
+            if (!co_await IdiCoWait{pEvent, waitMs}) {
+                dbg_printf("%s- reg[%u] not reported within %u ms, answered with its last value\n", 
+                            __FUNCTION__, pDpStruc->address, waitMs);
+            }
+        }
+        co_return IdiDpReadApply(aCB, false);
+    }
+#endif
+    co_return IdiDpReadApply(aCB, true);
+}
+
+
+/* IdiCoDpWrite: datapoint write written as a coroutine flow */
+static IdiTask IdiCoDpWrite(IdiActionCB& aCB)
+{
+    while (!IsFsmProcessingDone(aCB)) {
+        co_await IdiCoBusy{};
+    }
+    co_return IdiDpWriteApply(aCB);
+}
+#endif
+
+
 /* IdiGenericResultFsm: Example routine implementing a finite state machine */
 /* to simulate asynchronous processing of any registered callback routines  */
 /* and finally call the Action Callback Result to let Idl know we are done. */
@@ -1261,33 +1884,7 @@ int IdiGenericResultFsm(IdiActionCB& aCB)
         *  Do our write
         */
         if (IsFsmProcessingDone(aCB)) {
-            T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
-            if (pDpStruc) {
-                if (*pDpStruc->pDpValue) {
-                    // free existing Cjson object from the dp entry in per device's DevDpValue vector
-                    IdlCjsonDelete(*pDpStruc->pDpValue);
-                }
-
-                // update dp entry in in per device's DevDpValue vector
-                *pDpStruc->pDpValue = GetDpValForLocStorUpdate(aCB);
-                char *outStr = cJSON_PrintUnformatted(*pDpStruc->pDpValue);
-                dbg_printf(" Value written: %s at pDpStruc(%p)->pDpValue = %p\n", 
-                            outStr, pDpStruc, pDpStruc->pDpValue);
-
-#ifdef INCLUDE_ETI
-                uint reg = pDpStruc->address;
-                T__DevStoPtr pDevEntry = (T__DevStoPtr)(aCB.dev->idiDevData);
-                idlError = DevWritePublish(pDevEntry, reg, *pDpStruc->pDpValue);
-#endif
-                IdlMemFree(outStr);
-            } else {
-                idlError = IErr_Failure;
-                err_printf("ERROR: %s- Write error on unitialized idiDpData\n", __FUNCTION__);
-            }
-            if (aCB.args) {
-                IdiFree(aCB.args);
-            }
-            IdlDpWriteResult(aCB.ReqIndex, aCB.dev, aCB.dp, idlError);
+            idlError = IdiDpWriteApply(aCB);
         } else {
             idlError = IErr_IdiBusy;
         }
@@ -1297,41 +1894,7 @@ int IdiGenericResultFsm(IdiActionCB& aCB)
         *  Do our read
         */
         if (IsFsmProcessingDone(aCB)) {
-            T_DpSto *pDpStruc = (T_DpSto *)(aCB.dp->idiDpData);
-            double dpValue = 0;
-            if (pDpStruc) {
-#ifdef INCLUDE_ETI
-                uint reg = pDpStruc->address;
-                T__DevStoPtr pDevEntry = (T__DevStoPtr)(aCB.dev->idiDevData);
-                DevReadPublish(pDevEntry, reg);
-#endif
-                if (*pDpStruc->pDpValue) {
-                    char *jsonStr = cJSON_PrintUnformatted(*pDpStruc->pDpValue);
-                    idlError = SetDpValueFromDpLocalStorage(aCB, *pDpStruc->pDpValue, &dpValue);
-                    if (pDpStruc->testMultiplier != 0)
-                        dpValue *= pDpStruc->testMultiplier;
-                    if (idlError == IErr_Success) {
-                        /* 
-                        *    dbg_printf("%s Value read: %s (before applying multiplier: %lf) at pDpStruc(%p)->pDpValue = %p\n", 
-                        *         (aCB.lastError == IErr_IdiBusy) ? ".done\n" : "", 
-                        *         jsonStr, pDpStruc->testMultiplier, pDpStruc, pDpStruc->pDpValue);
-                        */
-                    } else {
-                        err_printf("ERROR: %s- Unable to read dp entry in localDpValuesVector\n", __FUNCTION__);
-                    }
-                    IdlMemFree(jsonStr);
-                } else {
-                    idlError = IErr_Failure;
-                    err_printf("ERROR: %s- No value found for dp entry in localDpValuesVector\n", __FUNCTION__);
-                }
-            } else {
-                idlError = IErr_Failure;
-                err_printf("ERROR: %s- Unitialized idiDpData - device possibly has been deleted!\n", __FUNCTION__);
-            }
-            if (aCB.args) {
-                IdiFree(aCB.args);
-            }
-            IdlDpReadResult(aCB.ReqIndex, aCB.dev, aCB.dp, aCB.context, idlError, prio_array, dpValue);
+            idlError = IdiDpReadApply(aCB, true);
         } else {
             idlError = IErr_IdiBusy;
         }
@@ -1371,26 +1934,59 @@ int IdiGenericResultFsm(IdiActionCB& aCB)
 }
 
 
-int IdiBlockWhileBusy(IdiActionCB& aCB) {
-    int idlError = IErr_Success;
+/* IdiActionResult: report the outcome of an action that did not complete */
+/* normally through the matching Idl*Result call                           */
+void IdiActionResult(IdiActionCB& aCB, int idlError)
+{
+    switch(aCB.action) {
+    case IdiaCreate:
+        IdlDevCreateResult(aCB.ReqIndex, aCB.dev, idlError);
+        break;
+    case IdiaProvision:
+        IdlDevProvisionResult(aCB.ReqIndex, aCB.dev, idlError);
+        break;
+    case IdiaDeprovision:
+        IdlDevDeprovisionResult(aCB.ReqIndex, aCB.dev, idlError);
+        break;
+    case IdiaReplace:
+        IdlDevReplaceResult(aCB.ReqIndex, aCB.dev, idlError);
+        break;
+    case IdiaDelete:
+        IdlDevDeleteResult(aCB.ReqIndex, aCB.dev, idlError);
+        break;
+    case IdiaDpread:
+        IdiReadReport(aCB, IdiReadExpire(aCB), idlError);
+        break;
+    case IdiaDpwrite:
+        IdiWriteReport(aCB, IdiWriteExpire(aCB), idlError);
+        break;
+    default:
+        // there is no IdlDpCreateResult to call..
+        break;
+    }
+    if (aCB.args) {
+        IdiFree(aCB.args);
+    }
+    aCB.lastError = idlError;
+}
 
-    if (aCB.action != IdiaNone) {
-        time_t timeStart = time(NULL);
-        while (aCB.action != IdiaNone) {
-            idlError = IdiGenericResultFsm(aCB);
-            if (idlError != IErr_IdiBusy) {
-                aCB.action = IdiaNone;     // done, clear the action for a new callback action.
-                break;
-            } else {
-                if ((uint) (time(NULL) - timeStart) >= aCB.timeout) {
-                    idlError = IErr_Failure;
-                    err_printf("\nERROR %s- Timed out on UNID: %s, action: %d, idlError: %s\n", __FUNCTION__, 
-                                    (aCB.dev->unid) ? aCB.dev->unid : "NULL", aCB.action, IErrToStr(idlError));
-                    break;
-                }
-            }
-        }
+
+/* IdiActionTimeout: called by the executor for an action whose deadline passed */
+int IdiActionTimeout(IdiActionCB& aCB)
+{
+    int idlError = IErr_DevCommFail;
+
+    if (aCB.action == IdiaDpread && aCB.lastError == IErr_Success) {
+        // never reached the device: shed from the backlog, the reads that joined it and
+        // still have time are posted again by IdiReadExpire
+        dbg_printf("%s- Dropped stale read on UNID: %s after %u ms\n", __FUNCTION__, 
+                        (aCB.dev && aCB.dev->unid) ? aCB.dev->unid : "NULL", aCB.timeout);
+    } else {
+        err_printf("\nERROR %s- Timed out on UNID: %s, action: %d after %u ms, idlError: %s\n", __FUNCTION__, 
+                        (aCB.dev && aCB.dev->unid) ? aCB.dev->unid : "NULL", aCB.action, aCB.timeout, 
+                        IErrToStr(idlError));
     }
+    IdiActionResult(aCB, idlError);
     return idlError;
 }
 
@@ -31,9 +31,15 @@
 #include "common.h"
 
 #define IdiFree(x) {if (x) { free(x); x = NULL;}}
-#define IDI_ACTION_NORMAL_TIMEOUT   30
-#define IDI_ACTION_LONG_TIMEOUT     50
+// Action deadlines are kept this many milliseconds below the IDL's request timeouts
+// (timeouts section of <cdname>-idl.conf) so the driver reports a failure before the IDL gives up.
+#define IDI_TIMEOUT_MARGIN          200
 #define IDI_ACT_Q                   "/dev_act_q_idi_%s"
+#define IDI_ACT_Q_SIZE              MQ_HARD_LIM     // default number of queued actions
+#define IDI_MQ_MSG_OVERHEAD         64              // kernel bookkeeping per mqueue message
+#define IDI_DEV_CHUNK               64              // device arenas allocated at a time
+#define IDI_DEV_ARENA_POOLS         4               // arena sizes pooled, one per XIF datapoint count
+#define IDI_READ_ANSWER_MS          1000            // coroutine reads wait this long for the device to report
 
 
 typedef enum {
@@ -49,6 +55,34 @@ typedef enum {
     Ida_last
 } IdiAction;
 
+// Scheduling lanes; every worker takes turns between them by weight
+typedef enum {
+    IdiLaneWrite = 0,               // datapoint writes
+    IdiLaneRead,                    // datapoint reads
+    IdiLaneLifecycle,               // device create, provision, deprovision, replace, delete
+    IdiLaneCount
+} IdiLane;
+
+#define IDI_SHARD_LANES             IdiLaneLifecycle    // lanes queued per shard
+
+// Executor bookkeeping carried by every queued action (maintained by idiexec.cpp)
+typedef struct _IdiExecInfo {
+    uint shard;                     // executor shard of the device
+    int lane;                       // IdiLane the action is queued on
+    size_t barrier[IDI_SHARD_LANES];    // shard lane positions a delete has to wait for
+    uint64_t enqueueMs;             // monotonic time the action was posted
+    uint64_t deadlineMs;            // enqueueMs + timeout
+    T_IdiTimer timer;               // fires at deadlineMs
+    int timedOut;                   // deadline passed while the action could not be expired
+    uint64_t wakeMs;                // monotonic time a parked action is retried
+    uint heapIdx;                   // position in the parked heap
+    uint backoffMs;                 // current retry interval while busy
+    uint retryMs;                   // retry interval asked for by the run function, 0 backs off
+    void *pCoro;                    // coroutine frame of the action (idicoro.cpp)
+    int state;                      // IdiSchedState, changed atomically
+    struct _IdiActionCB *pNext;     // next action of the same device waiting behind this one
+} T_IdiExecInfo;
+
 // Various IDL 'result' bits
 typedef struct _IdiActionCB {
     double dValue;
@@ -64,9 +98,12 @@ typedef struct _IdiActionCB {
     uint timeout;          // time out in milliseconds
     int lastError;
     void* context;
+    struct _DevSto *pDevSto;        // device storage held by a datapoint action, see DevStoHold
+    T_IdiExecInfo exec;
 } IdiActionCB;
 
-extern int IdiStart();
+extern int IdiStart(const char *confPath);
+extern void IdiShutdown(void);
 
 extern void *ProcAsynThrdFunc(void* argA);
 
@@ -0,0 +1,225 @@
+//
+// idicodec.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Hand written parsers for the IAP types of the XIF files
+//
+
+#include <ctype.h>
+
+#include "common.h"
+#include "idicodec.h"
+
+#if __has_include("idixif.h")
+#include "idixif.h"
+#endif
+
+#ifndef IDI_XIF_REG_COUNT
+#define IDI_XIF_REG_COUNT       0       // built without idixif.h, every value goes through cJSON
+#endif
+
+#ifndef IDI_XIF_CODEC_COUNT
+#define IDI_XIF_CODEC_COUNT     0
+#endif
+
+
+/* IdiXifRegOf: the row of a datapoint in the XIF of a program ID, NULL if it has none */
+const T_IdiXifReg *IdiXifRegOf(const char *pProgramId, const char *pDpName)
+{
+#if IDI_XIF_REG_COUNT > 0
+    int lo = 0;
+    int hi = IDI_XIF_REG_COUNT - 1;
+
+    while (pProgramId && pDpName && lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(pProgramId, gIdiXifRegs[mid].pProgramId);
+        if (cmp == 0) {
+            cmp = strcmp(pDpName, gIdiXifRegs[mid].pName);
+        }
+        if (cmp == 0) {
+            return &gIdiXifRegs[mid];
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+#endif
+    return NULL;
+}
+
+
+/* IdiCodecOf: the codec of an IAP type, or of one of its fields, NULL if the values go */
+/* through cJSON.  pIapField is "" (or NULL) for the whole type.                        */
+const T_IdiCodec *IdiCodecOf(const char *pIapType, const char *pIapField)
+{
+#if IDI_XIF_CODEC_COUNT > 0
+    int lo = 0;
+    int hi = IDI_XIF_CODEC_COUNT - 1;
+
+    if (pIapField == NULL) {
+        pIapField = "";
+    }
+    while (pIapType && lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(pIapType, gIdiXifCodecs[mid].pIapType);
+        if (cmp == 0) {
+            cmp = strcmp(pIapField, gIdiXifCodecs[mid].pIapField);
+        }
+        if (cmp == 0) {
+            return &gIdiXifCodecs[mid];
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+#endif
+    return NULL;
+}
+
+
+/* IdiCodecSkipSpace: skip JSON white space */
+static const char *IdiCodecSkipSpace(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+
+/* IdiCodecScanNumber: parse a JSON number, NULL if there is none at p */
+static const char *IdiCodecScanNumber(const char *p, double *pD)
+{
+    char *pEnd;
+    // strtod also takes inf, nan and hex numbers, none of them is made of these
+    size_t len = strspn(p, "+-.0123456789eE");
+
+    if (len == 0) {
+        return NULL;
+    }
+    *pD = strtod(p, &pEnd);
+    return (pEnd == p + len) ? pEnd : NULL;
+}
+
+
+/* IdiCodecParseNumber: a number and nothing else */
+static int IdiCodecParseNumber(T_IdiVal *pVal, const char *pText)
+{
+    double d;
+    const char *p = IdiCodecScanNumber(IdiCodecSkipSpace(pText), &d);
+
+    if (p == NULL || *IdiCodecSkipSpace(p) != '\0') {
+        return FAILURE;
+    }
+    IdiValSetDouble(pVal, d);
+    return SUCCESS;
+}
+
+
+/* IdiCodecParseObject: an object with exactly the codec's fields, all numbers, in any */
+/* order.  Kept as the canonical text cJSON_PrintUnformatted prints for it.            */
+static int IdiCodecParseObject(const T_IdiCodec *pCodec, T_IdiVal *pVal, const char *pText)
+{
+    double values[IDI_CODEC_FIELDS_MAX];
+    uint32_t seen = 0;
+    const char *p = IdiCodecSkipSpace(pText);
+
+    if (*p++ != '{' || pCodec->fieldCount > IDI_CODEC_FIELDS_MAX) {
+        return FAILURE;
+    }
+    for (;;) {
+        p = IdiCodecSkipSpace(p);
+        if (*p++ != '"') {
+            return FAILURE;
+        }
+        const char *pKey = p;
+        while (*p && *p != '"' && *p != '\\') {
+            p++;
+        }
+        if (*p != '"') {
+            return FAILURE;
+        }
+        size_t keyLen = p++ - pKey;
+        uint i;
+        for (i = 0; i < pCodec->fieldCount; i++) {
+            if (strncmp(pCodec->ppFields[i], pKey, keyLen) == 0 && pCodec->ppFields[i][keyLen] == '\0') {
+                break;
+            }
+        }
+        if (i == pCodec->fieldCount || (seen & (1u << i))) {
+            return FAILURE;
+        }
+        p = IdiCodecSkipSpace(p);
+        if (*p++ != ':') {
+            return FAILURE;
+        }
+        p = IdiCodecScanNumber(IdiCodecSkipSpace(p), &values[i]);
+        if (p == NULL) {
+            return FAILURE;
+        }
+        seen |= 1u << i;
+        p = IdiCodecSkipSpace(p);
+        if (*p == ',') {
+            p++;
+        } else if (*p == '}') {
+            break;
+        } else {
+            return FAILURE;
+        }
+    }
+    if (*IdiCodecSkipSpace(p + 1) != '\0' || seen != (1u << pCodec->fieldCount) - 1) {
+        return FAILURE;
+    }
+
+    T_IdiBuf *pBuf = IdiBufLocal();
+    bool bOk = IdiBufPut(pBuf, "{");
+    for (uint i = 0; bOk && i < pCodec->fieldCount; i++) {
+        bOk = IdiBufPut(pBuf, i ? ",\"" : "\"") && IdiBufPut(pBuf, pCodec->ppFields[i]) && 
+              IdiBufPut(pBuf, "\":") && IdiBufPutNumber(pBuf, values[i]);
+    }
+    if (!bOk || !IdiBufPut(pBuf, "}")) {
+        return FAILURE;
+    }
+    return IdiValSetJsonText(pVal, pBuf->pData, pBuf->len);
+}
+
+
+/* IdiCodecParse: set the value given as JSON text through the codec, through cJSON */
+/* (IdiValParse) if there is no codec or the text does not have the codec's shape   */
+int IdiCodecParse(const T_IdiCodec *pCodec, T_IdiVal *pVal, const char *pText)
+{
+    if (pCodec && pText) {
+        if (pCodec->kind == IdiCodecNumber && IdiCodecParseNumber(pVal, pText) == SUCCESS) {
+            return SUCCESS;
+        }
+        if (pCodec->kind == IdiCodecObject && IdiCodecParseObject(pCodec, pVal, pText) == SUCCESS) {
+            return SUCCESS;
+        }
+    }
+    return IdiValParse(pVal, pText);
+}
@@ -0,0 +1,75 @@
+//
+// idicodec.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Codecs for the IAP types of the driver's XIF files.  xifcodec.sh (make codec, run by
+// every build) reads the XIF files and generates idixif.h: a constexpr register map of
+// every datapoint row and the codecs, sorted by IAP type and field, its values take.  A
+// value of a known shape is parsed by hand into its canonical JSON text, e.g. the
+// {"value","state"} object of SNVT_switch, a field or a scalar type as a number;
+// anything else, and any text that does not have the expected shape, goes through
+// cJSON as before.  Built without idixif.h every value goes through cJSON.
+//
+
+#ifndef IDICODEC_H
+#define IDICODEC_H
+
+#include <sys/types.h>
+
+#include "idival.h"
+
+#define IDI_CODEC_FIELDS_MAX    16      // most fields of an object codec
+
+typedef enum {
+    IdiCodecNone = 0,                   // through cJSON
+    IdiCodecNumber,                     // a number
+    IdiCodecObject,                     // an object of number fields
+} IdiCodecKind;
+
+typedef struct _IdiCodec {
+    const char *pIapType;
+    const char *pIapField;              // "" for the whole type
+    IdiCodecKind kind;
+    uint fieldCount;                    // of an object, printed in this order
+    const char *const *ppFields;
+} T_IdiCodec;
+
+// One datapoint row of the XIF files, the map is sorted by program ID and name
+typedef struct _IdiXifReg {
+    const char *pProgramId;
+    const char *pName;
+    const char *pIapType;
+    const char *pIapField;
+    const char *pNativeType;
+    bool bWritable;
+    uint address;
+    const T_IdiCodec *pCodec;           // NULL if the values go through cJSON
+} T_IdiXifReg;
+
+
+extern const T_IdiXifReg *IdiXifRegOf(const char *pProgramId, const char *pDpName);
+extern const T_IdiCodec *IdiCodecOf(const char *pIapType, const char *pIapField);
+extern int IdiCodecParse(const T_IdiCodec *pCodec, T_IdiVal *pVal, const char *pText);
+
+#endif
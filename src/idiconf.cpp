@@ -0,0 +1,261 @@
+//
+// idiconf.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Driver settings from <cdname>-idl.conf
+//
+
+#include "common.h"
+#include "idiconf.h"
+
+// timeouts section keys, as the IDL reads them
+typedef struct {
+    const char *key;
+    size_t offset;
+    uint defaultMs;
+} T_IdiTimeoutKey;
+
+static const T_IdiTimeoutKey gTimeoutKeys[] = {
+    {"Device create timeout ms",        offsetof(Timeouts, devCreateTimeoutMs),      DEFAULT_CREATE_TMOUT},
+    {"Device provision timeout ms",     offsetof(Timeouts, devProvisionTimeoutMs),   DEFAULT_PROV_TMOUT},
+    {"Device deprovision timeout ms",   offsetof(Timeouts, devDeprovisionTimeoutMs), DEFAULT_DEPROV_TMOUT},
+    {"Device replace timeout ms",       offsetof(Timeouts, devReplaceTimeoutMs),     DEFAULT_REPLACE_TMOUT},
+    {"Device delete timeout ms",        offsetof(Timeouts, devDeleteTimeoutMs),      DEFAULT_DEL_TMOUT},
+    {"Datapoint read timeout ms",       offsetof(Timeouts, dpReadTimeoutMs),         DEFAULT_READ_TMOUT},
+    {"Datapoint write timeout ms",      offsetof(Timeouts, dpWriteTimeoutMs),        DEFAULT_WRITE_TMOUT},
+};
+
+
+/* IdiConfReadFile: read a whole file into a null terminated buffer */
+static char *IdiConfReadFile(const char *path)
+{
+    char *pBuf = NULL;
+    long size = 0;
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        pBuf = (char *)malloc(size + 1);
+        if (pBuf && fread(pBuf, 1, size, fp) != (size_t)size) {
+            IdiFree(pBuf);
+        }
+        if (pBuf) {
+            pBuf[size] = '\0';
+        }
+    }
+    fclose(fp);
+    return pBuf;
+}
+
+
+/* IdiConfGetUint: read an optional non-negative number into *pValue */
+static void IdiConfGetUint(cJSON *pObj, const char *key, uint *pValue)
+{
+    cJSON *pItem = cJSON_GetObjectItemCaseSensitive(pObj, key);
+
+    if (pItem && cJSON_IsNumber(pItem) && pItem->valuedouble >= 0) {
+        *pValue = (uint)pItem->valuedouble;
+    }
+}
+
+
+/* IdiConfGetCollapse: read the write collapsing switch and the types excluded from it */
+static void IdiConfGetCollapse(cJSON *pObj, T_IdiConf *pConf)
+{
+    cJSON *pOn = cJSON_GetObjectItemCaseSensitive(pObj, IDI_CONF_COLLAPSE_ON);
+    cJSON *pTypes = cJSON_GetObjectItemCaseSensitive(pObj, IDI_CONF_COLLAPSE_EXCL);
+    cJSON *pType;
+
+    pConf->bCollapseWrites = cJSON_IsTrue(pOn);
+    if (pTypes == NULL || !cJSON_IsArray(pTypes) || cJSON_GetArraySize(pTypes) == 0) {
+        return;
+    }
+    pConf->ppNoCollapseTypes = (char **)calloc(cJSON_GetArraySize(pTypes), sizeof(char *));
+    if (pConf->ppNoCollapseTypes == NULL) {
+        err_printf("ERROR: %s- out of memory, write collapsing disabled\n", __FUNCTION__);
+        pConf->bCollapseWrites = false;
+        return;
+    }
+    cJSON_ArrayForEach(pType, pTypes) {
+        if (cJSON_IsString(pType) && pType->valuestring[0] != '\0') {
+            pConf->ppNoCollapseTypes[pConf->noCollapseCount++] = strdup(pType->valuestring);
+        }
+    }
+}
+
+
+/* IdiConfLoad: fill pConf with the defaults, then with whatever the conf file */
+/* sets.  A missing or unreadable file leaves the defaults in place.          */
+int IdiConfLoad(const char *confPath, T_IdiConf *pConf)
+{
+    IdiExecLaneDefaults(pConf->lanes);
+    pConf->devMaxCount = CDDEVLIMIT;
+    pConf->queueDepth = IDI_ACT_Q_SIZE;
+    pConf->snapRegsPerDev = 0;
+    pConf->snapFlushMs = IDI_SNAP_FLUSH_MS;
+    for (uint i = 0; i < sizeof(gTimeoutKeys) / sizeof(gTimeoutKeys[0]); i++) {
+        *(uint *)((char *)&pConf->timeouts + gTimeoutKeys[i].offset) = gTimeoutKeys[i].defaultMs;
+    }
+
+    char *pText = IdiConfReadFile(confPath);
+    if (pText == NULL) {
+        info_printf("INFO: %s- %s not readable, using default settings\n", __FUNCTION__, confPath);
+        return FAILURE;
+    }
+    cJSON *pRoot = cJSON_Parse(pText);
+    IdiFree(pText);
+    if (pRoot == NULL || !cJSON_IsObject(pRoot)) {
+        err_printf("ERROR: %s- unable to parse %s, using default settings\n", __FUNCTION__, confPath);
+        cJSON_Delete(pRoot);
+        return FAILURE;
+    }
+
+    // the same limit the IDL reports in the driver's about object
+    cJSON *pAbout = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_ABOUT);
+    if (pAbout && cJSON_IsObject(pAbout)) {
+        IdiConfGetUint(pAbout, DEV_LIMIT_STR, &pConf->devMaxCount);
+        if (pConf->devMaxCount == 0) {
+            pConf->devMaxCount = CDDEVLIMIT;
+        }
+    }
+    info_printf("INFO: %s- device max count %u\n", __FUNCTION__, pConf->devMaxCount);
+
+    cJSON *pQueue = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_QUEUE);
+    if (pQueue && cJSON_IsObject(pQueue)) {
+        IdiConfGetUint(pQueue, IDI_CONF_QUEUE_DEPTH, &pConf->queueDepth);
+        if (pConf->queueDepth == 0) {
+            pConf->queueDepth = IDI_ACT_Q_SIZE;
+        }
+    }
+    info_printf("INFO: %s- action queue depth %u\n", __FUNCTION__, pConf->queueDepth);
+
+    cJSON *pLanes = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_LANES);
+    for (uint lane = 0; pLanes && lane < IdiLaneCount; lane++) {
+        cJSON *pLane = cJSON_GetObjectItemCaseSensitive(pLanes, IdiExecLaneName(lane));
+        if (pLane && cJSON_IsObject(pLane)) {
+            IdiConfGetUint(pLane, IDI_CONF_LANE_WEIGHT, &pConf->lanes[lane].weight);
+            IdiConfGetUint(pLane, IDI_CONF_LANE_BUDGET, &pConf->lanes[lane].budgetMs);
+            IdiConfGetUint(pLane, IDI_CONF_LANE_LIMIT, &pConf->lanes[lane].limit);
+            IdiConfGetUint(pLane, IDI_CONF_LANE_SHED, &pConf->lanes[lane].shedMs);
+        }
+        info_printf("INFO: %s- %s lane: weight %u, latency budget %u ms, limit %u, shed wait %u ms\n", 
+                        __FUNCTION__, IdiExecLaneName(lane), pConf->lanes[lane].weight, 
+                        pConf->lanes[lane].budgetMs, pConf->lanes[lane].limit, pConf->lanes[lane].shedMs);
+    }
+
+    cJSON *pTimeouts = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_TIMEOUTS);
+    for (uint i = 0; pTimeouts && i < sizeof(gTimeoutKeys) / sizeof(gTimeoutKeys[0]); i++) {
+        uint *pValue = (uint *)((char *)&pConf->timeouts + gTimeoutKeys[i].offset);
+        IdiConfGetUint(pTimeouts, gTimeoutKeys[i].key, pValue);
+        if (*pValue == 0) {
+            *pValue = gTimeoutKeys[i].defaultMs;
+        }
+    }
+    info_printf("INFO: %s- datapoint read timeout %u ms, write timeout %u ms\n", __FUNCTION__, 
+                    pConf->timeouts.dpReadTimeoutMs, pConf->timeouts.dpWriteTimeoutMs);
+
+    cJSON *pCollapse = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_COLLAPSE);
+    if (pCollapse && cJSON_IsObject(pCollapse)) {
+        IdiConfGetCollapse(pCollapse, pConf);
+    }
+    info_printf("INFO: %s- write collapsing %s, %u excluded types\n", __FUNCTION__, 
+                    pConf->bCollapseWrites ? "enabled" : "disabled", pConf->noCollapseCount);
+
+    cJSON *pSnapshot = cJSON_GetObjectItemCaseSensitive(pRoot, IDI_CONF_SNAPSHOT);
+    if (pSnapshot && cJSON_IsObject(pSnapshot) && 
+            cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(pSnapshot, IDI_CONF_SNAP_ON))) {
+        pConf->snapRegsPerDev = IDI_SNAP_REGS_PER_DEV;
+        IdiConfGetUint(pSnapshot, IDI_CONF_SNAP_REGS, &pConf->snapRegsPerDev);
+        IdiConfGetUint(pSnapshot, IDI_CONF_SNAP_FLUSH, &pConf->snapFlushMs);
+        if (pConf->snapFlushMs == 0) {
+            pConf->snapFlushMs = IDI_SNAP_FLUSH_MS;
+        }
+    }
+    if (pConf->snapRegsPerDev) {
+        info_printf("INFO: %s- register snapshot of %u registers per device, flushed every %u ms\n", 
+                        __FUNCTION__, pConf->snapRegsPerDev, pConf->snapFlushMs);
+    } else {
+        info_printf("INFO: %s- register snapshot disabled\n", __FUNCTION__);
+    }
+    cJSON_Delete(pRoot);
+
+    return SUCCESS;
+}
+
+
+/* IdiConfCollapsesWrites: true when queued writes to dp may be collapsed, that */
+/* is collapsing is enabled and the IAP type of dp is not excluded              */
+bool IdiConfCollapsesWrites(const T_IdiConf *pConf, IdlDatapoint *dp)
+{
+    IdlIapDatapoint *pIapDp = dp->info.parentIapdp;
+
+    if (!pConf->bCollapseWrites) {
+        return false;
+    }
+    for (uint i = 0; pIapDp && i < pConf->noCollapseCount; i++) {
+        const char *pType = pConf->ppNoCollapseTypes[i];
+        if ((pIapDp->info.iapType && strcmp(pIapDp->info.iapType, pType) == 0) ||
+                (pIapDp->info.xifIapType && strcmp(pIapDp->info.xifIapType, pType) == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* IdiConfDeadlineMs: how long an action may take from the moment it is queued.  */
+/* The IDL timeout of the request less IDI_TIMEOUT_MARGIN, so a stale action is   */
+/* answered with an error while the IDL still waits for it.                       */
+uint IdiConfDeadlineMs(const T_IdiConf *pConf, IdiAction action)
+{
+    uint timeoutMs;
+
+    switch (action) {
+    case IdiaDpread:
+        timeoutMs = pConf->timeouts.dpReadTimeoutMs;
+        break;
+    case IdiaDpwrite:
+        timeoutMs = pConf->timeouts.dpWriteTimeoutMs;
+        break;
+    case IdiaProvision:
+        timeoutMs = pConf->timeouts.devProvisionTimeoutMs;
+        break;
+    case IdiaDeprovision:
+        timeoutMs = pConf->timeouts.devDeprovisionTimeoutMs;
+        break;
+    case IdiaReplace:
+        timeoutMs = pConf->timeouts.devReplaceTimeoutMs;
+        break;
+    case IdiaDelete:
+        timeoutMs = pConf->timeouts.devDeleteTimeoutMs;
+        break;
+    default:
+        // device and datapoint creation
+        timeoutMs = pConf->timeouts.devCreateTimeoutMs;
+        break;
+    }
+    return (timeoutMs > 2 * IDI_TIMEOUT_MARGIN) ? timeoutMs - IDI_TIMEOUT_MARGIN : timeoutMs / 2;
+}
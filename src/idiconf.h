@@ -0,0 +1,70 @@
+//
+// idiconf.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Driver settings read from the driver section of <cdname>-idl.conf.  The IDL
+// reads the same file for its own settings; keys it does not know are ignored.
+//
+
+#ifndef IDICONF_H
+#define IDICONF_H
+
+#include "idiexec.h"
+
+#define IDI_CONF_LANES          "action lanes"
+#define IDI_CONF_LANE_WEIGHT    "weight"
+#define IDI_CONF_LANE_BUDGET    "latency budget ms"
+#define IDI_CONF_LANE_LIMIT     "limit"
+#define IDI_CONF_LANE_SHED      "shed wait ms"
+#define IDI_CONF_QUEUE          "action queue"
+#define IDI_CONF_QUEUE_DEPTH    "depth"
+#define IDI_CONF_COLLAPSE       "write collapsing"
+#define IDI_CONF_COLLAPSE_ON    "enabled"
+#define IDI_CONF_COLLAPSE_EXCL  "excluded types"
+#define IDI_CONF_TIMEOUTS       "timeouts"
+#define IDI_CONF_SNAPSHOT       "register snapshot"
+#define IDI_CONF_SNAP_ON        "enabled"
+#define IDI_CONF_SNAP_REGS      "registers per device"
+#define IDI_CONF_SNAP_FLUSH     "flush interval ms"
+#define IDI_CONF_ABOUT          "about object details"
+
+
+typedef struct _IdiConf {
+    uint devMaxCount;                       // devices the driver takes, DEV_LIMIT_STR of the about object
+    uint queueDepth;                        // actions that may be queued or running at a time
+    T_IdiLaneConf lanes[IdiLaneCount];
+    bool bCollapseWrites;                   // queued writes to one register: only the newest is applied
+    char **ppNoCollapseTypes;               // IAP types whose every write counts (pulses, counters)
+    uint noCollapseCount;
+    Timeouts timeouts;                      // the IDL's request timeouts, the action deadlines derive from them
+    uint snapRegsPerDev;                    // register snapshot records per device, 0 for no snapshot
+    uint snapFlushMs;                       // time between flushes of the snapshot's dirty pages
+} T_IdiConf;
+
+
+extern int IdiConfLoad(const char *confPath, T_IdiConf *pConf);
+extern bool IdiConfCollapsesWrites(const T_IdiConf *pConf, IdlDatapoint *dp);
+extern uint IdiConfDeadlineMs(const T_IdiConf *pConf, IdiAction action);
+
+#endif
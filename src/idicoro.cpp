@@ -0,0 +1,225 @@
+//
+// idicoro.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// Coroutine device transactions run by the action executor
+//
+
+#include "common.h"
+
+#ifdef IDI_USE_COROUTINES
+
+#include "idicoro.h"
+
+typedef std::coroutine_handle<IdiTask::promise_type> T_IdiCoHandle;
+
+typedef struct _IdiCo {
+    T_IdiPool framePool;
+    T_IdiCoFlowFn flows[Ida_last];          // coroutine flow per action, NULL runs pfnRun
+    T_IdiActionRunFn pfnRun;                // steps the actions that have no flow
+    T_IdiActionRunFn pfnExpire;             // completes an action whose deadline passed
+    std::atomic<bool> bOversizeWarned;
+} T_IdiCo;
+
+static T_IdiCo gIdiCo;
+
+
+/* operator new: take a coroutine frame from the pool.  A flow with a bigger frame */
+/* than a pool slot still works, from the heap.  NULL makes IdiCoRun retry later.  */
+void *IdiTask::promise_type::operator new(size_t size) noexcept
+{
+    if (size <= IDI_CORO_FRAME_SIZE) {
+        return IdiPoolAlloc(&gIdiCo.framePool);
+    }
+    if (!gIdiCo.bOversizeWarned.exchange(true)) {
+        err_printf("WARN: %s- coroutine frame of %zu bytes exceeds IDI_CORO_FRAME_SIZE (%u)\n",
+                    __FUNCTION__, size, IDI_CORO_FRAME_SIZE);
+    }
+    return malloc(size);
+}
+
+
+/* operator delete: give a coroutine frame back */
+void IdiTask::promise_type::operator delete(void *pFrame, size_t size)
+{
+    if (size <= IDI_CORO_FRAME_SIZE) {
+        IdiPoolRelease(&gIdiCo.framePool, pFrame);
+    } else {
+        free(pFrame);
+    }
+}
+
+
+/* IdiCoWait::await_suspend: register as the event's waiter */
+void IdiCoWait::await_suspend(T_IdiCoHandle h) noexcept
+{
+    IdiTask::promise_type& p = h.promise();
+    uint64_t now = IdiNowMs();
+
+    p.pWaitEvent = pEvent;
+    p.untilMs = timeoutMs ? now + timeoutMs : p.pActCb->exec.deadlineMs;
+    pEvent->pWaiter.store(p.pActCb, std::memory_order_release);
+    // IdiCoRun looks at bSet before resuming, a signal racing with this is not lost
+}
+
+
+/* IdiCoWait::await_resume: reset the event, true if it was signalled */
+bool IdiCoWait::await_resume() noexcept
+{
+    return pEvent->bSet.exchange(false, std::memory_order_acq_rel);
+}
+
+
+/* IdiCoWait::~IdiCoWait: stop waiting, also when the flow is destroyed at its deadline. */
+/* A concurrent IdiCoSignal may still be resuming the action, wait for it to finish.     */
+IdiCoWait::~IdiCoWait()
+{
+    pEvent->pWaiter.store(NULL, std::memory_order_release);
+    while (pEvent->signalling.load(std::memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+
+/* IdiCoEventInit: initialize an event as not signalled and without waiter */
+void IdiCoEventInit(T_IdiCoEvent *pEvent)
+{
+    pEvent->bSet.store(false, std::memory_order_relaxed);
+    pEvent->pWaiter.store(NULL, std::memory_order_relaxed);
+    pEvent->signalling.store(0, std::memory_order_release);
+}
+
+
+/* IdiCoEventReset: forget a signal nobody waited for, before asking for what is */
+/* to signal the event next                                                      */
+void IdiCoEventReset(T_IdiCoEvent *pEvent)
+{
+    pEvent->bSet.store(false, std::memory_order_release);
+}
+
+
+/* IdiCoSignal: set an event and have the flow waiting on it resumed.  May be */
+/* called from any thread, e.g. the ETI message handler.                     */
+void IdiCoSignal(T_IdiCoEvent *pEvent)
+{
+    pEvent->signalling.fetch_add(1, std::memory_order_acq_rel);
+    pEvent->bSet.store(true, std::memory_order_release);
+    IdiActionCB *pActCb = pEvent->pWaiter.load(std::memory_order_acquire);
+    if (pActCb) {
+        IdiExecResume(pActCb);
+    }
+    pEvent->signalling.fetch_sub(1, std::memory_order_release);
+}
+
+
+/* IdiCoInit: preallocate frameCount coroutine frames.  pfnRun steps the actions */
+/* without a flow, pfnExpire completes any action whose deadline passed.        */
+int IdiCoInit(uint frameCount, T_IdiActionRunFn pfnRun, T_IdiActionRunFn pfnExpire)
+{
+    memset(gIdiCo.flows, 0, sizeof(gIdiCo.flows));
+    gIdiCo.pfnRun = pfnRun;
+    gIdiCo.pfnExpire = pfnExpire;
+    gIdiCo.bOversizeWarned.store(false);
+
+    if (IdiPoolInit(&gIdiCo.framePool, frameCount, IDI_CORO_FRAME_SIZE) != SUCCESS) {
+        return FAILURE;
+    }
+    info_printf("INFO: %s- %u coroutine frames of %u bytes\n", __FUNCTION__, frameCount, IDI_CORO_FRAME_SIZE);
+
+    return SUCCESS;
+}
+
+
+/* IdiCoFlowSet: run the given action type as a coroutine flow */
+void IdiCoFlowSet(IdiAction action, T_IdiCoFlowFn pfnFlow)
+{
+    if (action < Ida_last) {
+        gIdiCo.flows[action] = pfnFlow;
+    }
+}
+
+
+/* IdiCoRun: executor run function.  Starts or resumes the action's flow and */
+/* returns its result once it is done, IErr_IdiBusy while it is suspended.   */
+int IdiCoRun(IdiActionCB& aCB)
+{
+    T_IdiCoHandle h;
+
+    if (aCB.exec.pCoro == NULL) {
+        T_IdiCoFlowFn pfnFlow = (aCB.action < Ida_last) ? gIdiCo.flows[aCB.action] : NULL;
+        if (pfnFlow == NULL) {
+            return gIdiCo.pfnRun(aCB);
+        }
+        h = pfnFlow(aCB).handle;
+        if (!h) {
+            // all frames in use: try again once some flow finished
+            aCB.lastError = IErr_IdiBusy;
+            return IErr_IdiBusy;
+        }
+        h.promise().pActCb = &aCB;
+        h.promise().pWaitEvent = NULL;
+        h.promise().untilMs = 0;
+        h.promise().result = IErr_Success;
+        aCB.exec.pCoro = h.address();
+    } else {
+        h = T_IdiCoHandle::from_address(aCB.exec.pCoro);
+    }
+
+    IdiTask::promise_type& p = h.promise();
+    bool bSignalled = p.pWaitEvent && p.pWaitEvent->bSet.load(std::memory_order_acquire);
+    uint64_t now = IdiNowMs();
+    if (!bSignalled && now < p.untilMs) {
+        // woken before its time: keep it parked, IdiExecResume brings it back earlier
+        uint64_t waitMs = p.untilMs - now;
+        aCB.exec.retryMs = (waitMs < UINT32_MAX) ? (uint)waitMs : UINT32_MAX;
+        aCB.lastError = IErr_IdiBusy;
+        return IErr_IdiBusy;
+    }
+    p.pWaitEvent = NULL;
+    p.untilMs = 0;
+
+    h.resume();
+    if (!h.done()) {
+        aCB.lastError = IErr_IdiBusy;
+        return IErr_IdiBusy;
+    }
+    int idlError = p.result;
+    h.destroy();
+    aCB.exec.pCoro = NULL;
+    aCB.lastError = idlError;
+
+    return idlError;
+}
+
+
+/* IdiCoExpire: executor expire function, drops the action's flow first */
+int IdiCoExpire(IdiActionCB& aCB)
+{
+    if (aCB.exec.pCoro) {
+        T_IdiCoHandle::from_address(aCB.exec.pCoro).destroy();
+        aCB.exec.pCoro = NULL;
+    }
+    return gIdiCo.pfnExpire(aCB);
+}
+
+#endif  // IDI_USE_COROUTINES
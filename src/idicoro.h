@@ -0,0 +1,116 @@
+//
+// idicoro.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// Device transactions as C++20 coroutines (-DIDI_USE_COROUTINES, needs -std=c++20).
+// A flow registered for an action with IdiCoFlowSet is started the first time the
+// executor runs the action and resumed on every later run until it co_returns the
+// action's IErr_* result.  While it is suspended the action is parked by the
+// executor like any action reporting IErr_IdiBusy; a flow waiting on an event is
+// not resumed before the event is signalled or its wait timed out.  Frames
+// come from a preallocated pool of IDI_CORO_FRAME_SIZE byte slots.
+//
+
+#ifndef IDICORO_H
+#define IDICORO_H
+
+#ifdef IDI_USE_COROUTINES
+
+#include <coroutine>
+
+#include "idiexec.h"
+
+#ifndef IDI_CORO_FRAME_SIZE
+#define IDI_CORO_FRAME_SIZE     256     // bytes per preallocated coroutine frame
+#endif
+
+
+// One-shot signal a flow can wait on, e.g. for a device's answer.  At most one
+// flow waits on an event at a time; it is reset when the waiting flow wakes up.
+typedef struct _IdiCoEvent {
+    std::atomic<bool> bSet;
+    std::atomic<IdiActionCB *> pWaiter;
+    std::atomic<int> signalling;            // IdiCoSignal calls still using pWaiter
+} T_IdiCoEvent;
+
+struct IdiTask {
+    struct promise_type {
+        IdiActionCB *pActCb;                // the action this flow runs
+        T_IdiCoEvent *pWaitEvent;           // event the flow waits on, if any
+        uint64_t untilMs;                   // not resumed before, unless pWaitEvent is set
+        int result;
+
+        static void *operator new(size_t size) noexcept;
+        static void operator delete(void *pFrame, size_t size);
+        static IdiTask get_return_object_on_allocation_failure() noexcept { return IdiTask{NULL}; }
+
+        IdiTask get_return_object() noexcept {
+            return IdiTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(int idlError) noexcept { result = idlError; }
+        void unhandled_exception() noexcept { result = IErr_Failure; }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+typedef IdiTask (*T_IdiCoFlowFn)(IdiActionCB& aCB);
+
+// co_await IdiCoBusy{}: give the worker back and be retried after the executor's busy
+// backoff, or after retryMs when it is not 0
+struct IdiCoBusy {
+    uint retryMs;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<IdiTask::promise_type> h) noexcept {
+        h.promise().pActCb->exec.retryMs = retryMs;
+    }
+    void await_resume() const noexcept {}
+};
+
+// co_await IdiCoWait{&event, timeoutMs}: resume once the event is signalled or after
+// timeoutMs (0 waits until the action's deadline); true if it was signalled
+struct IdiCoWait {
+    T_IdiCoEvent *pEvent;
+    uint timeoutMs;
+
+    bool await_ready() const noexcept { return pEvent->bSet.load(std::memory_order_acquire); }
+    void await_suspend(std::coroutine_handle<IdiTask::promise_type> h) noexcept;
+    bool await_resume() noexcept;
+    ~IdiCoWait();
+};
+
+
+extern int IdiCoInit(uint frameCount, T_IdiActionRunFn pfnRun, T_IdiActionRunFn pfnExpire);
+extern void IdiCoFlowSet(IdiAction action, T_IdiCoFlowFn pfnFlow);
+extern int IdiCoRun(IdiActionCB& aCB);
+extern int IdiCoExpire(IdiActionCB& aCB);
+extern void IdiCoEventInit(T_IdiCoEvent *pEvent);
+extern void IdiCoEventReset(T_IdiCoEvent *pEvent);
+extern void IdiCoSignal(T_IdiCoEvent *pEvent);
+
+#endif  // IDI_USE_COROUTINES
+
+#endif
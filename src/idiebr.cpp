@@ -0,0 +1,170 @@
+//
+// idiebr.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Epoch based reclamation of objects replaced while other threads may use them
+//
+
+#include "common.h"
+
+typedef struct {
+    alignas(IDI_CACHE_LINE) std::atomic<uint64_t> epoch;  // epoch the section started in, 0 outside
+    std::atomic<bool> bUsed;
+} T_IdiEbrSlot;
+
+typedef struct {
+    std::atomic<uint64_t> epoch;                // advanced by every retire
+    T_IdiEbrSlot slots[IDI_EBR_SLOTS];
+    std::atomic<int> overflowReaders;           // sections of threads without a slot
+    pthread_mutex_t lock;                       // protects the retired list
+    T_IdiEbrRetired *pRetired;
+    uint retiredCount;
+} T_IdiEbr;
+
+static T_IdiEbr gIdiEbr = { {1}, {}, {0}, PTHREAD_MUTEX_INITIALIZER, NULL, 0 };
+static thread_local T_IdiEbrSlot *tpIdiEbrSlot;
+static thread_local uint tIdiEbrDepth;
+static thread_local bool tbIdiEbrOverflow;
+
+
+/* IdiEbrSlotClaim: give the calling thread a slot of its own, for good */
+static T_IdiEbrSlot *IdiEbrSlotClaim(void)
+{
+    for (uint i = 0; i < IDI_EBR_SLOTS; i++) {
+        bool bUsed = false;
+        if (gIdiEbr.slots[i].bUsed.compare_exchange_strong(bUsed, true)) {
+            return &gIdiEbr.slots[i];
+        }
+    }
+    err_printf("WARN: %s- all %u reclamation slots are taken, retired objects wait for this thread\n", 
+                __FUNCTION__, IDI_EBR_SLOTS);
+    return NULL;
+}
+
+
+/* IdiEbrEnter: start a section in which shared objects may be used.  Sections nest. */
+void IdiEbrEnter(void)
+{
+    if (tIdiEbrDepth++ > 0) {
+        return;
+    }
+    if (tpIdiEbrSlot == NULL && !tbIdiEbrOverflow) {
+        tpIdiEbrSlot = IdiEbrSlotClaim();
+        tbIdiEbrOverflow = (tpIdiEbrSlot == NULL);
+    }
+    if (tpIdiEbrSlot) {
+        tpIdiEbrSlot->epoch.store(gIdiEbr.epoch.load(), std::memory_order_relaxed);
+    } else {
+        gIdiEbr.overflowReaders.fetch_add(1, std::memory_order_relaxed);
+    }
+    // pairs with the fence in IdiEbrReclaim: either the reclaimer sees this section
+    // or this section sees every object retired before the reclaimer looked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+
+/* IdiEbrExit: end the section, nothing used in it may be used any more */
+void IdiEbrExit(void)
+{
+    if (--tIdiEbrDepth > 0) {
+        return;
+    }
+    if (tpIdiEbrSlot) {
+        tpIdiEbrSlot->epoch.store(0, std::memory_order_release);
+    } else {
+        gIdiEbr.overflowReaders.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+/* IdiEbrRetire: free pObj with pfnFree once no section that may still use it is open. */
+/* pObj must no longer be reachable for sections starting from now on.                */
+void IdiEbrRetire(void *pObj, T_IdiEbrFreeFn pfnFree)
+{
+    T_IdiEbrRetired *pRetired = (T_IdiEbrRetired *)malloc(sizeof(T_IdiEbrRetired));
+    bool bReclaim;
+
+    if (pRetired == NULL) {
+        // nowhere to keep it, leaking it is safer than freeing it under a reader
+        err_printf("ERROR: %s- failed to allocate a retired object entry\n", __FUNCTION__);
+        return;
+    }
+    pRetired->pObj = pObj;
+    pRetired->pfnFree = pfnFree;
+    // sections starting after this saw the epoch advance and cannot reach pObj
+    pRetired->epoch = gIdiEbr.epoch.fetch_add(1);
+
+    pthread_mutex_lock(&gIdiEbr.lock);
+    pRetired->pNext = gIdiEbr.pRetired;
+    gIdiEbr.pRetired = pRetired;
+    bReclaim = (++gIdiEbr.retiredCount >= IDI_EBR_BATCH);
+    pthread_mutex_unlock(&gIdiEbr.lock);
+
+    if (bReclaim) {
+        IdiEbrReclaim();
+    }
+}
+
+
+/* IdiEbrReclaim: free the retired objects no open section can use any more */
+void IdiEbrReclaim(void)
+{
+    T_IdiEbrRetired *pFree = NULL;
+    // a section missed by the scan below starts in this epoch or later, so only objects
+    // retired before it are out of its reach; those retired meanwhile have to wait
+    uint64_t minEpoch = gIdiEbr.epoch.load();
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (gIdiEbr.overflowReaders.load(std::memory_order_acquire) > 0) {
+        return;
+    }
+    for (uint i = 0; i < IDI_EBR_SLOTS; i++) {
+        uint64_t epoch = gIdiEbr.slots[i].epoch.load(std::memory_order_acquire);
+        if (epoch && epoch < minEpoch) {
+            minEpoch = epoch;
+        }
+    }
+
+    pthread_mutex_lock(&gIdiEbr.lock);
+    T_IdiEbrRetired **ppRetired = &gIdiEbr.pRetired;
+    while (*ppRetired) {
+        T_IdiEbrRetired *pRetired = *ppRetired;
+        if (pRetired->epoch < minEpoch) {
+            *ppRetired = pRetired->pNext;
+            pRetired->pNext = pFree;
+            pFree = pRetired;
+            gIdiEbr.retiredCount--;
+        } else {
+            ppRetired = &pRetired->pNext;
+        }
+    }
+    pthread_mutex_unlock(&gIdiEbr.lock);
+
+    while (pFree) {
+        T_IdiEbrRetired *pRetired = pFree;
+        pFree = pRetired->pNext;
+        pRetired->pfnFree(pRetired->pObj);
+        free(pRetired);
+    }
+}
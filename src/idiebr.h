@@ -0,0 +1,59 @@
+//
+// idiebr.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Epoch based reclamation.  A thread reading shared objects that may be replaced
+// concurrently brackets its use with IdiEbrEnter/IdiEbrExit; the thread replacing
+// an object hands the old one to IdiEbrRetire, which frees it once no thread can
+// still be inside a section that started before it was retired.  Readers never
+// block and never take a lock.
+//
+
+#ifndef IDIEBR_H
+#define IDIEBR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <atomic>
+
+#define IDI_EBR_SLOTS           64      // threads that can have a section of their own
+#define IDI_EBR_BATCH           32      // retired objects collected before they are reclaimed
+
+typedef void (*T_IdiEbrFreeFn)(void *pObj);
+
+typedef struct _IdiEbrRetired {
+    void *pObj;
+    T_IdiEbrFreeFn pfnFree;
+    uint64_t epoch;                     // global epoch when it was retired
+    struct _IdiEbrRetired *pNext;
+} T_IdiEbrRetired;
+
+
+extern void IdiEbrEnter(void);
+extern void IdiEbrExit(void);
+extern void IdiEbrRetire(void *pObj, T_IdiEbrFreeFn pfnFree);
+extern void IdiEbrReclaim(void);
+
+#endif
@@ -0,0 +1,273 @@
+//
+// idienum.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Enum lookup tables built once per enum map
+//
+
+#include <ctype.h>
+#include <limits.h>
+#include <strings.h>
+
+#include "common.h"
+#include "idienum.h"
+
+typedef struct {
+    pthread_mutex_t lock;               // protects the list, tables never change once built
+    T_IdiEnumTab *pTabs;
+} T_IdiEnumTabs;
+
+static T_IdiEnumTabs gIdiEnumTabs = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+
+/* IdiEnumHashInt: spread an enum value over the slots */
+static uint32_t IdiEnumHashInt(int value)
+{
+    uint32_t hash = (uint32_t)value * 0x9e3779b1u;
+
+    return hash ^ (hash >> 16);
+}
+
+
+/* IdiEnumHashStr: FNV-1a hash of the lower case form of a string */
+static uint32_t IdiEnumHashStr(const char *pStr)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*pStr) {
+        hash ^= (uint8_t)tolower((unsigned char)*pStr++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/* IdiEnumKey: hash of an enum map's values and strings, identical maps share a table */
+static uint64_t IdiEnumKey(const IapTypeEnumObj *pEnum)
+{
+    uint64_t key = 14695981039346656037ull ^ (uint64_t)pEnum->count;
+
+    for (int i = 0; i < pEnum->count; i++) {
+        const char *pStr = pEnum->enumMap[i].enumStr ? pEnum->enumMap[i].enumStr : "";
+        key = (key ^ (uint32_t)pEnum->enumMap[i].value) * 1099511628211ull;
+        while (*pStr) {
+            key = (key ^ (uint8_t)*pStr++) * 1099511628211ull;
+        }
+        key = (key ^ 0xff) * 1099511628211ull;
+    }
+    return key;
+}
+
+
+/* IdiEnumMatches: true if the table was built from a map equal to pEnum */
+static bool IdiEnumMatches(const T_IdiEnumTab *pTab, uint64_t key, const IapTypeEnumObj *pEnum)
+{
+    if (pTab->key != key || pTab->count != pEnum->count) {
+        return false;
+    }
+    for (int i = 0; i < pEnum->count; i++) {
+        const char *pStr = pEnum->enumMap[i].enumStr ? pEnum->enumMap[i].enumStr : "";
+        if (pTab->pValues[i] != pEnum->enumMap[i].value || strcmp(pTab->ppStrs[i], pStr) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* IdiEnumTabBuild: build the table of an enum map in a single allocation.  The first */
+/* of duplicate values or strings wins, as it did when the map was searched.           */
+static T_IdiEnumTab *IdiEnumTabBuild(const IapTypeEnumObj *pEnum, uint64_t key)
+{
+    int count = pEnum->count;
+    int minValue = pEnum->enumMap[0].value;
+    int maxValue = minValue;
+    size_t strSize = 0;
+    uint slots = 8;
+
+    for (int i = 0; i < count; i++) {
+        const char *pStr = pEnum->enumMap[i].enumStr ? pEnum->enumMap[i].enumStr : "";
+        minValue = (pEnum->enumMap[i].value < minValue) ? pEnum->enumMap[i].value : minValue;
+        maxValue = (pEnum->enumMap[i].value > maxValue) ? pEnum->enumMap[i].value : maxValue;
+        strSize += strlen(pStr) + 1;
+    }
+    // at most half full
+    while (slots < 2 * (uint)count) {
+        slots <<= 1;
+    }
+    int64_t span = (int64_t)maxValue - minValue + 1;
+    uint valueSpan = (span <= IDI_ENUM_DENSE_MAX) ? (uint)span : 0;
+
+    size_t size = sizeof(T_IdiEnumTab) + count * sizeof(int) + count * sizeof(char *) + 
+                    (valueSpan ? valueSpan * sizeof(int) : slots * sizeof(T_IdiEnumSlot)) + 
+                    slots * sizeof(T_IdiEnumSlot) + strSize;
+    char *pBlock = (char *)malloc(size);
+    if (pBlock == NULL) {
+        err_printf("ERROR: %s- failed to allocate an enum table of %zu bytes\n", __FUNCTION__, size);
+        return NULL;
+    }
+    // the pointer arrays first, the int arrays and the strings after them
+    T_IdiEnumTab *pTab = (T_IdiEnumTab *)pBlock;
+    pBlock += sizeof(T_IdiEnumTab);
+    pTab->ppStrs = (char **)pBlock;
+    pBlock += count * sizeof(char *);
+    pTab->pStrSlots = (T_IdiEnumSlot *)pBlock;
+    pBlock += slots * sizeof(T_IdiEnumSlot);
+    pTab->pValueSlots = NULL;
+    pTab->pIdxByValue = NULL;
+    if (valueSpan) {
+        pTab->pIdxByValue = (int *)pBlock;
+        pBlock += valueSpan * sizeof(int);
+    } else {
+        pTab->pValueSlots = (T_IdiEnumSlot *)pBlock;
+        pBlock += slots * sizeof(T_IdiEnumSlot);
+    }
+    pTab->pValues = (int *)pBlock;
+    pBlock += count * sizeof(int);
+
+    pTab->pNext = NULL;
+    pTab->key = key;
+    pTab->count = count;
+    pTab->minValue = minValue;
+    pTab->valueSpan = valueSpan;
+    pTab->mask = slots - 1;
+    for (uint i = 0; i < slots; i++) {
+        pTab->pStrSlots[i].idx = -1;
+        if (pTab->pValueSlots) {
+            pTab->pValueSlots[i].idx = -1;
+        }
+    }
+    for (uint i = 0; i < valueSpan; i++) {
+        pTab->pIdxByValue[i] = -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const char *pStr = pEnum->enumMap[i].enumStr ? pEnum->enumMap[i].enumStr : "";
+        int value = pEnum->enumMap[i].value;
+        uint32_t hash;
+        uint s;
+
+        pTab->pValues[i] = value;
+        pTab->ppStrs[i] = strcpy(pBlock, pStr);
+        pBlock += strlen(pStr) + 1;
+
+        if (valueSpan) {
+            if (pTab->pIdxByValue[value - minValue] < 0) {
+                pTab->pIdxByValue[value - minValue] = i;
+            }
+        } else {
+            hash = IdiEnumHashInt(value);
+            for (s = hash & pTab->mask; pTab->pValueSlots[s].idx >= 0; s = (s + 1) & pTab->mask) {
+                if (pTab->pValues[pTab->pValueSlots[s].idx] == value) {
+                    break;
+                }
+            }
+            if (pTab->pValueSlots[s].idx < 0) {
+                pTab->pValueSlots[s].hash = hash;
+                pTab->pValueSlots[s].idx = i;
+            }
+        }
+
+        hash = IdiEnumHashStr(pStr);
+        for (s = hash & pTab->mask; pTab->pStrSlots[s].idx >= 0; s = (s + 1) & pTab->mask) {
+            if (pTab->pStrSlots[s].hash == hash && strcasecmp(pTab->ppStrs[pTab->pStrSlots[s].idx], pStr) == 0) {
+                break;
+            }
+        }
+        if (pTab->pStrSlots[s].idx < 0) {
+            pTab->pStrSlots[s].hash = hash;
+            pTab->pStrSlots[s].idx = i;
+        }
+    }
+
+    return pTab;
+}
+
+
+/* IdiEnumTabGet: the lookup table of an enum map, built on first use.  NULL for */
+/* a datapoint without enum map or when the table can not be allocated.          */
+const T_IdiEnumTab *IdiEnumTabGet(const IapTypeEnumObj *pEnum)
+{
+    T_IdiEnumTab *pTab;
+
+    if (pEnum->enumMap == NULL || pEnum->count <= 0) {
+        return NULL;
+    }
+    uint64_t key = IdiEnumKey(pEnum);
+    pthread_mutex_lock(&gIdiEnumTabs.lock);
+    for (pTab = gIdiEnumTabs.pTabs; pTab; pTab = pTab->pNext) {
+        if (IdiEnumMatches(pTab, key, pEnum)) {
+            break;
+        }
+    }
+    if (pTab == NULL) {
+        pTab = IdiEnumTabBuild(pEnum, key);
+        if (pTab) {
+            pTab->pNext = gIdiEnumTabs.pTabs;
+            gIdiEnumTabs.pTabs = pTab;
+            dbg_printf("%s: enum table of %d entries, %s value lookup\n", __FUNCTION__, pTab->count, 
+                        pTab->valueSpan ? "dense" : "hashed");
+        }
+    }
+    pthread_mutex_unlock(&gIdiEnumTabs.lock);
+
+    return pTab;
+}
+
+
+/* IdiEnumIdxOfValue: index of the enum map entry with the given value, -1 if none */
+int IdiEnumIdxOfValue(const T_IdiEnumTab *pTab, double value)
+{
+    // enum values are ints, anything else is not in the map
+    if (!(value >= INT_MIN && value <= INT_MAX) || value != (double)(int)value) {
+        return -1;
+    }
+    int intValue = (int)value;
+    if (pTab->valueSpan) {
+        int64_t offset = (int64_t)intValue - pTab->minValue;
+        return (offset >= 0 && offset < pTab->valueSpan) ? pTab->pIdxByValue[offset] : -1;
+    }
+    uint32_t hash = IdiEnumHashInt(intValue);
+    for (uint s = hash & pTab->mask; pTab->pValueSlots[s].idx >= 0; s = (s + 1) & pTab->mask) {
+        if (pTab->pValues[pTab->pValueSlots[s].idx] == intValue) {
+            return pTab->pValueSlots[s].idx;
+        }
+    }
+    return -1;
+}
+
+
+/* IdiEnumIdxOfStr: index of the enum map entry with the given string ignoring */
+/* case, -1 if none                                                             */
+int IdiEnumIdxOfStr(const T_IdiEnumTab *pTab, const char *pStr)
+{
+    uint32_t hash = IdiEnumHashStr(pStr);
+
+    for (uint s = hash & pTab->mask; pTab->pStrSlots[s].idx >= 0; s = (s + 1) & pTab->mask) {
+        if (pTab->pStrSlots[s].hash == hash && strcasecmp(pTab->ppStrs[pTab->pStrSlots[s].idx], pStr) == 0) {
+            return pTab->pStrSlots[s].idx;
+        }
+    }
+    return -1;
+}
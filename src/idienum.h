@@ -0,0 +1,69 @@
+//
+// idienum.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Enum lookup tables.  A datapoint's enum map (dp->info.iapEnum) is searched in both
+// directions on every value it converts: the value a write brings to the index of its
+// enum string and an enum string a device reports to its value.  A table built when
+// the datapoint is created answers both in O(1): values through a dense array when
+// they span a small range, through a hash otherwise, strings through a hash of their
+// lower case form.  Datapoints with the same enum map share a table, tables live as
+// long as the driver.
+//
+
+#ifndef IDIENUM_H
+#define IDIENUM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "libidl.h"
+
+#define IDI_ENUM_DENSE_MAX      1024    // widest value range looked up through a dense array
+
+typedef struct _IdiEnumSlot {
+    uint32_t hash;                      // of the value or the lower case string
+    int idx;                            // index into the enum map, -1 for a free slot
+} T_IdiEnumSlot;
+
+typedef struct _IdiEnumTab {
+    struct _IdiEnumTab *pNext;          // tables built so far
+    uint64_t key;                       // hash of the enum map's values and strings
+    int count;                          // enum map entries
+    int *pValues;                       // value per index
+    char **ppStrs;                      // string per index
+    int minValue;
+    uint valueSpan;                     // entries of pIdxByValue, 0 when pValueSlots is used
+    int *pIdxByValue;                   // index per value - minValue, -1 for none
+    T_IdiEnumSlot *pValueSlots;         // index per value when the values are too far apart
+    T_IdiEnumSlot *pStrSlots;           // index per string, case insensitive
+    uint mask;                          // slots - 1 of both hashes
+} T_IdiEnumTab;
+
+
+extern const T_IdiEnumTab *IdiEnumTabGet(const IapTypeEnumObj *pEnum);
+extern int IdiEnumIdxOfValue(const T_IdiEnumTab *pTab, double value);
+extern int IdiEnumIdxOfStr(const T_IdiEnumTab *pTab, const char *pStr);
+
+#endif
@@ -0,0 +1,1231 @@
+//
+// idiexec.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// Device action executor: worker pool, per-device routing and lifecycle stealing
+//
+
+#include "common.h"
+#include "idiexec.h"
+
+
+#define IDI_HEAP_NONE           UINT32_MAX
+#define IDI_WAKE_NEVER          UINT64_MAX
+#define IDI_WAIT_AVG_SCALE      16          // fixed point scale of the queueing delay average
+#define IDI_WAIT_AVG_SHIFT      3           // the average moves by 1/8 of the difference per action
+
+static T_IdiExec gIdiExec = {};
+static const char *gLaneNames[IdiLaneCount] = {"write", "read", "lifecycle"};
+
+#ifndef IDI_USE_MQUEUE
+static std::atomic<int> gLifecycleBusy(0);      // set while a worker owns the lifecycle ring
+static std::atomic<int> gStalledShard(-1);      // shard the stalled lifecycle action waits for
+static std::atomic<uint64_t> gLifecycleWakeMs(IDI_WAKE_NEVER);  // earliest retry or deadline of a lifecycle action
+static std::atomic<uint64_t> gLifecycleHeadMs(IDI_WAKE_NEVER);  // enqueue time of the oldest queued lifecycle action
+#endif
+
+
+/* IdiNowMs: monotonic time in milliseconds */
+uint64_t IdiNowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+#ifndef IDI_USE_MQUEUE
+/* IdiExecHash: FNV-1a hash of a device key string */
+static uint32_t IdiExecHash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*key) {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/* IdiExecShardOf: route a device to a shard.  The handle is used as it does */
+/* not change when the device is replaced (unid does).                       */
+static T_IdiShard *IdiExecShardOf(IdlDev *dev)
+{
+    uint32_t hash = 0;
+
+    if (dev) {
+        if (dev->handle) {
+            hash = IdiExecHash(dev->handle);
+        } else if (dev->unid) {
+            hash = IdiExecHash(dev->unid);
+        } else {
+            hash = (uint32_t)((uintptr_t)dev >> 4);
+        }
+    }
+    return &gIdiExec.pShards[hash % gIdiExec.shardCount];
+}
+#endif
+
+
+/* IdiExecLaneOf: lane of an action; anything that creates, changes or removes */
+/* a device rather than accessing one of its datapoints is a lifecycle action  */
+static IdiLane IdiExecLaneOf(const IdiActionCB *pActCb)
+{
+    if (pActCb->dev && pActCb->action == IdiaDpwrite) {
+        return IdiLaneWrite;
+    }
+    if (pActCb->dev && pActCb->action == IdiaDpread) {
+        return IdiLaneRead;
+    }
+    return IdiLaneLifecycle;
+}
+
+
+//
+// Parked action heap, ordered by wake time
+//
+
+static void IdiHeapSwap(T_IdiSched *pSched, uint i, uint j)
+{
+    IdiActionCB *pTmp = pSched->ppHeap[i];
+    pSched->ppHeap[i] = pSched->ppHeap[j];
+    pSched->ppHeap[j] = pTmp;
+    pSched->ppHeap[i]->exec.heapIdx = i;
+    pSched->ppHeap[j]->exec.heapIdx = j;
+}
+
+
+static void IdiHeapSiftUp(T_IdiSched *pSched, uint i)
+{
+    while (i > 0) {
+        uint parent = (i - 1) / 2;
+        if (pSched->ppHeap[parent]->exec.wakeMs <= pSched->ppHeap[i]->exec.wakeMs) {
+            break;
+        }
+        IdiHeapSwap(pSched, i, parent);
+        i = parent;
+    }
+}
+
+
+static void IdiHeapSiftDown(T_IdiSched *pSched, uint i)
+{
+    for (;;) {
+        uint left = 2 * i + 1;
+        uint least = i;
+        if (left < pSched->heapCount && 
+            pSched->ppHeap[left]->exec.wakeMs < pSched->ppHeap[least]->exec.wakeMs) {
+            least = left;
+        }
+        if (left + 1 < pSched->heapCount && 
+            pSched->ppHeap[left + 1]->exec.wakeMs < pSched->ppHeap[least]->exec.wakeMs) {
+            least = left + 1;
+        }
+        if (least == i) {
+            break;
+        }
+        IdiHeapSwap(pSched, i, least);
+        i = least;
+    }
+}
+
+
+static void IdiHeapPush(T_IdiSched *pSched, IdiActionCB *pActCb)
+{
+    // the heap is as large as the action pool, it can not overflow
+    uint i = pSched->heapCount++;
+    pSched->ppHeap[i] = pActCb;
+    pActCb->exec.heapIdx = i;
+    IdiHeapSiftUp(pSched, i);
+}
+
+
+static void IdiHeapRemove(T_IdiSched *pSched, IdiActionCB *pActCb)
+{
+    uint i = pActCb->exec.heapIdx;
+
+    if (i == IDI_HEAP_NONE) {
+        return;
+    }
+    pActCb->exec.heapIdx = IDI_HEAP_NONE;
+    uint last = --pSched->heapCount;
+    if (i != last) {
+        pSched->ppHeap[i] = pSched->ppHeap[last];
+        pSched->ppHeap[i]->exec.heapIdx = i;
+        IdiHeapSiftDown(pSched, i);
+        IdiHeapSiftUp(pSched, i);
+    }
+}
+
+
+static uint64_t IdiHeapNextWake(T_IdiSched *pSched)
+{
+    return pSched->heapCount ? pSched->ppHeap[0]->exec.wakeMs : IDI_WAKE_NEVER;
+}
+
+
+//
+// Device gates: open addressing on the IdlDev pointer with linear probing
+//
+
+static uint IdiGateSlot(T_IdiSched *pSched, IdlDev *dev)
+{
+    return (uint)(((uintptr_t)dev >> 4) * 2654435761u) & (pSched->gateSize - 1);
+}
+
+
+static T_IdiGate *IdiGateFind(T_IdiSched *pSched, IdlDev *dev)
+{
+    if (dev == NULL || pSched->gateCount == 0) {
+        return NULL;
+    }
+    for (uint i = IdiGateSlot(pSched, dev); pSched->pGates[i].dev; i = (i + 1) & (pSched->gateSize - 1)) {
+        if (pSched->pGates[i].dev == dev) {
+            return &pSched->pGates[i];
+        }
+    }
+    return NULL;
+}
+
+
+static int IdiGateResize(T_IdiSched *pSched, uint size)
+{
+    T_IdiGate *pOld = pSched->pGates;
+    uint oldSize = pSched->gateSize;
+
+    T_IdiGate *pNew = (T_IdiGate *)calloc(size, sizeof(T_IdiGate));
+    if (pNew == NULL) {
+        err_printf("ERROR: %s- failed to allocate %u device gates\n", __FUNCTION__, size);
+        return FAILURE;
+    }
+    pSched->pGates = pNew;
+    pSched->gateSize = size;
+    for (uint i = 0; i < oldSize; i++) {
+        if (pOld[i].dev) {
+            uint j = IdiGateSlot(pSched, pOld[i].dev);
+            while (pNew[j].dev) {
+                j = (j + 1) & (size - 1);
+            }
+            pNew[j] = pOld[i];
+        }
+    }
+    IdlMemFree(pOld);
+    return SUCCESS;
+}
+
+
+static T_IdiGate *IdiGateAdd(T_IdiSched *pSched, IdlDev *dev)
+{
+    if ((pSched->gateCount + 1) * 2 > pSched->gateSize && 
+        IdiGateResize(pSched, pSched->gateSize * 2) != SUCCESS) {
+        return NULL;
+    }
+    uint i = IdiGateSlot(pSched, dev);
+    while (pSched->pGates[i].dev) {
+        i = (i + 1) & (pSched->gateSize - 1);
+    }
+    pSched->pGates[i].dev = dev;
+    pSched->pGates[i].pWaitHead = pSched->pGates[i].pWaitTail = NULL;
+    pSched->gateCount++;
+    return &pSched->pGates[i];
+}
+
+
+static void IdiGateRemove(T_IdiSched *pSched, T_IdiGate *pGate)
+{
+    uint mask = pSched->gateSize - 1;
+    uint i = (uint)(pGate - pSched->pGates);
+
+    // backward shift deletion keeps the probe sequences intact without tombstones
+    for (uint j = (i + 1) & mask; pSched->pGates[j].dev; j = (j + 1) & mask) {
+        uint home = IdiGateSlot(pSched, pSched->pGates[j].dev);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            pSched->pGates[i] = pSched->pGates[j];
+            i = j;
+        }
+    }
+    pSched->pGates[i].dev = NULL;
+    pSched->gateCount--;
+}
+
+
+/* IdiSchedInit: allocate a scheduler's parked heap, resume ring and gate table */
+static int IdiSchedInit(T_IdiSched *pSched)
+{
+    pSched->heapSize = gIdiExec.depth;
+    pSched->ppHeap = (IdiActionCB **)calloc(pSched->heapSize, sizeof(IdiActionCB *));
+    pSched->pGates = (T_IdiGate *)calloc(IDI_GATE_INIT_SIZE, sizeof(T_IdiGate));
+    pSched->gateSize = IDI_GATE_INIT_SIZE;
+    if (pSched->ppHeap == NULL || pSched->pGates == NULL) {
+        err_printf("ERROR: %s- failed to allocate the scheduler\n", __FUNCTION__);
+        return FAILURE;
+    }
+    IdiWheelInit(&pSched->wheel, IdiNowMs());
+    return IdiRingInit(&pSched->resumeRing, gIdiExec.depth);
+}
+
+
+/* IdiSchedNextWake: earliest time a parked action is retried or a deadline passes */
+static uint64_t IdiSchedNextWake(T_IdiSched *pSched)
+{
+    uint64_t wake = IdiHeapNextWake(pSched);
+    uint64_t deadline = IdiWheelNextMs(&pSched->wheel);
+
+    return (deadline < wake) ? deadline : wake;
+}
+
+
+/* IdiSchedPark: keep a busy action aside until its wake time, backing off while */
+/* it stays busy.  Later actions of its device queue up behind it.              */
+static void IdiSchedPark(T_IdiSched *pSched, IdiActionCB *pActCb, uint64_t now)
+{
+    if (pActCb->exec.retryMs) {
+        // the run function knows when it wants to be retried
+        pActCb->exec.wakeMs = now + pActCb->exec.retryMs;
+        pActCb->exec.retryMs = 0;
+    } else {
+        uint backoff = pActCb->exec.backoffMs * 2;
+
+        if (backoff < IDI_BUSY_RETRY_MIN_MS) {
+            backoff = IDI_BUSY_RETRY_MIN_MS;
+        } else if (backoff > IDI_BUSY_RETRY_MAX_MS) {
+            backoff = IDI_BUSY_RETRY_MAX_MS;
+        }
+        pActCb->exec.backoffMs = backoff;
+        pActCb->exec.wakeMs = now + backoff;
+    }
+
+    int expected = IdiSchedRunning;
+    if (!__atomic_compare_exchange_n(&pActCb->exec.state, &expected, IdiSchedParked, false, 
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // IdiExecResume came in while the action was running: retry right away
+        pActCb->exec.wakeMs = now;
+        __atomic_store_n(&pActCb->exec.state, IdiSchedParked, __ATOMIC_RELEASE);
+    }
+    if (pActCb->dev && !IdiGateFind(pSched, pActCb->dev)) {
+        IdiGateAdd(pSched, pActCb->dev);
+    }
+    IdiHeapPush(pSched, pActCb);
+}
+
+
+/* IdiSchedRelease: count an action as completed and give its slot back */
+static void IdiSchedRelease(T_IdiSched *pSched, T_IdiShard *pShard, IdiActionCB *pActCb)
+{
+    IdiTimerCancel(&pSched->wheel, &pActCb->exec.timer);
+    if (pShard) {
+        pShard->completed.fetch_add(1, std::memory_order_release);
+    }
+    IdiPoolRelease(&gIdiExec.actPool, pActCb);
+}
+
+
+/* IdiSchedFinish: release a finished action and return the next action of the */
+/* same device that was waiting behind it, if any                              */
+static IdiActionCB *IdiSchedFinish(T_IdiSched *pSched, T_IdiShard *pShard, IdiActionCB *pActCb)
+{
+    IdiActionCB *pNext = NULL;
+
+    T_IdiGate *pGate = IdiGateFind(pSched, pActCb->dev);
+    if (pGate) {
+        pNext = pGate->pWaitHead;
+        if (pNext) {
+            pGate->pWaitHead = pNext->exec.pNext;
+            if (pGate->pWaitHead == NULL) {
+                pGate->pWaitTail = NULL;
+            }
+            pNext->exec.pNext = NULL;
+        } else {
+            IdiGateRemove(pSched, pGate);
+        }
+    }
+    IdiSchedRelease(pSched, pShard, pActCb);
+
+    return pNext;
+}
+
+
+/* IdiSchedDispatch: run an action one step; park it when busy, otherwise finish */
+/* it and carry on with the actions of its device waiting behind it.  An action */
+/* past its deadline is expired instead of run.                                 */
+static void IdiSchedDispatch(T_IdiSched *pSched, T_IdiShard *pShard, IdiActionCB *pActCb)
+{
+    while (pActCb) {
+        int idlError = IErr_IdiBusy;
+        uint64_t now = IdiNowMs();
+
+        if (!pActCb->exec.timedOut && now < pActCb->exec.deadlineMs) {
+            __atomic_store_n(&pActCb->exec.state, IdiSchedRunning, __ATOMIC_RELEASE);
+            idlError = gIdiExec.pfnRun(*pActCb);
+            if (idlError == IErr_IdiBusy) {
+                now = IdiNowMs();
+                if (now < pActCb->exec.deadlineMs) {
+                    IdiSchedPark(pSched, pActCb, now);
+                    return;
+                }
+            }
+        }
+        if (idlError == IErr_IdiBusy) {
+            gIdiExec.pfnExpire(*pActCb);
+        }
+        pActCb = IdiSchedFinish(pSched, pShard, pActCb);
+    }
+}
+
+
+/* IdiExecDequeued: take a dequeued action off its lane's count and feed its */
+/* queueing delay into the lane's average                                    */
+static void IdiExecDequeued(IdiActionCB *pActCb)
+{
+    T_IdiLaneStat *pStat = &gIdiExec.laneStat[pActCb->exec.lane];
+    uint64_t now = IdiNowMs();
+    int64_t waitMs = (now > pActCb->exec.enqueueMs) ? (int64_t)(now - pActCb->exec.enqueueMs) : 0;
+
+    pStat->queued.fetch_sub(1, std::memory_order_relaxed);
+    pStat->admitted.fetch_add(1, std::memory_order_relaxed);
+    pStat->headEnqueueMs.store(pActCb->exec.enqueueMs, std::memory_order_relaxed);
+    // racy read-modify-write between workers, good enough for an average
+    int64_t avg = pStat->waitAvg.load(std::memory_order_relaxed);
+    avg += (waitMs * IDI_WAIT_AVG_SCALE - avg) >> IDI_WAIT_AVG_SHIFT;
+    pStat->waitAvg.store((uint)avg, std::memory_order_relaxed);
+}
+
+
+/* IdiSchedAdmit: arm the deadline of a newly dequeued action and run it unless */
+/* its device has a parked action, in which case it waits behind it             */
+static void IdiSchedAdmit(T_IdiSched *pSched, T_IdiShard *pShard, IdiActionCB *pActCb)
+{
+    T_IdiGate *pGate = IdiGateFind(pSched, pActCb->dev);
+
+    IdiExecDequeued(pActCb);
+    pActCb->exec.timer.pOwner = pActCb;
+    IdiTimerAdd(&pSched->wheel, &pActCb->exec.timer, pActCb->exec.deadlineMs);
+    if (pGate) {
+        pActCb->exec.pNext = NULL;
+        if (pGate->pWaitTail) {
+            pGate->pWaitTail->exec.pNext = pActCb;
+        } else {
+            pGate->pWaitHead = pActCb;
+        }
+        pGate->pWaitTail = pActCb;
+    } else {
+        IdiSchedDispatch(pSched, pShard, pActCb);
+    }
+}
+
+
+/* IdiSchedAdmitBatch: admit a batch of dequeued actions grouped by device, so */
+/* the I/O and completions of one device go out back to back.  The actions of  */
+/* a device keep their order.                                                  */
+static void IdiSchedAdmitBatch(T_IdiSched *pSched, T_IdiShard *pShard, IdiActionCB **ppBatch, uint count)
+{
+    for (uint i = 0; i < count; i++) {
+        if (ppBatch[i] == NULL) {
+            continue;
+        }
+        IdlDev *dev = ppBatch[i]->dev;
+        for (uint j = i; j < count; j++) {
+            if (ppBatch[j] && ppBatch[j]->dev == dev) {
+                IdiActionCB *pActCb = ppBatch[j];
+                ppBatch[j] = NULL;
+                IdiSchedAdmit(pSched, pShard, pActCb);
+            }
+        }
+    }
+}
+
+
+/* IdiSchedUnwait: take an action off the wait list of its device gate */
+static void IdiSchedUnwait(T_IdiSched *pSched, IdiActionCB *pActCb)
+{
+    T_IdiGate *pGate = IdiGateFind(pSched, pActCb->dev);
+    IdiActionCB *pPrev = NULL;
+
+    if (pGate == NULL) {
+        return;
+    }
+    for (IdiActionCB *pCur = pGate->pWaitHead; pCur; pPrev = pCur, pCur = pCur->exec.pNext) {
+        if (pCur == pActCb) {
+            if (pPrev) {
+                pPrev->exec.pNext = pCur->exec.pNext;
+            } else {
+                pGate->pWaitHead = pCur->exec.pNext;
+            }
+            if (pGate->pWaitTail == pCur) {
+                pGate->pWaitTail = pPrev;
+            }
+            pCur->exec.pNext = NULL;
+            break;
+        }
+    }
+}
+
+
+typedef struct {
+    T_IdiSched *pSched;
+    T_IdiShard *pShard;
+} T_IdiSchedCtx;
+
+/* IdiSchedExpire: wheel callback for an action whose deadline passed */
+static void IdiSchedExpire(T_IdiTimer *pTimer, void *pvCtx)
+{
+    T_IdiSchedCtx *pCtx = (T_IdiSchedCtx *)pvCtx;
+    IdiActionCB *pActCb = (IdiActionCB *)pTimer->pOwner;
+    int expected = IdiSchedParked;
+
+    if (__atomic_compare_exchange_n(&pActCb->exec.state, &expected, IdiSchedRunning, false, 
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        IdiHeapRemove(pCtx->pSched, pActCb);
+        gIdiExec.pfnExpire(*pActCb);
+        IdiSchedDispatch(pCtx->pSched, pCtx->pShard, IdiSchedFinish(pCtx->pSched, pCtx->pShard, pActCb));
+    } else if (expected == IdiSchedQueued) {
+        // never ran, it was waiting behind a parked action of its device
+        IdiSchedUnwait(pCtx->pSched, pActCb);
+        gIdiExec.pfnExpire(*pActCb);
+        IdiSchedRelease(pCtx->pSched, pCtx->pShard, pActCb);
+    } else {
+        // resumed: it is in the resume ring and gets expired when it comes out
+        pActCb->exec.timedOut = 1;
+    }
+}
+
+
+/* IdiSchedPoll: retry the parked actions that were resumed or whose wake time */
+/* has come and expire those past their deadline.  Returns true when anything  */
+/* was run.                                                                    */
+static bool IdiSchedPoll(T_IdiSched *pSched, T_IdiShard *pShard)
+{
+    bool bRan = false;
+    IdiActionCB *pActCb = NULL;
+
+    while (IdiRingPop(&pSched->resumeRing, (void **)&pActCb)) {
+        IdiHeapRemove(pSched, pActCb);
+        IdiSchedDispatch(pSched, pShard, pActCb);
+        bRan = true;
+    }
+    uint64_t now = IdiNowMs();
+    T_IdiSchedCtx ctx = {pSched, pShard};
+    if (IdiWheelNextMs(&pSched->wheel) <= now) {
+        bRan = true;
+    }
+    IdiWheelAdvance(&pSched->wheel, now, IdiSchedExpire, &ctx);
+    while (pSched->heapCount && pSched->ppHeap[0]->exec.wakeMs <= now) {
+        pActCb = pSched->ppHeap[0];
+        IdiHeapRemove(pSched, pActCb);
+        int expected = IdiSchedParked;
+        if (__atomic_compare_exchange_n(&pActCb->exec.state, &expected, IdiSchedRunning, false, 
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            IdiSchedDispatch(pSched, pShard, pActCb);
+            bRan = true;
+        }
+        // else it is sitting in the resume ring and will be run from there
+    }
+    return bRan;
+}
+
+
+/* IdiExecLaneName: name of a lane as used in the conf file and the logs */
+const char *IdiExecLaneName(uint lane)
+{
+    return (lane < IdiLaneCount) ? gLaneNames[lane] : "unknown";
+}
+
+
+/* IdiExecStatsGet: copy the admission counters of every lane into pStats */
+/* (IdiLaneCount entries)                                                 */
+void IdiExecStatsGet(T_IdiLaneStats *pStats)
+{
+    for (uint lane = 0; lane < IdiLaneCount; lane++) {
+        T_IdiLaneStat *pStat = &gIdiExec.laneStat[lane];
+        pStats[lane].queued = pStat->queued.load(std::memory_order_relaxed);
+        pStats[lane].admitted = pStat->admitted.load(std::memory_order_relaxed);
+        pStats[lane].rejected = pStat->rejected.load(std::memory_order_relaxed);
+        pStats[lane].waitAvgMs = pStat->waitAvg.load(std::memory_order_relaxed) / IDI_WAIT_AVG_SCALE;
+    }
+}
+
+
+/* IdiExecStatsTick: log the lane counters every IDI_STATS_PERIOD_MS if there */
+/* was traffic since the last time.  Called by every worker, one of them logs. */
+static void IdiExecStatsTick(void)
+{
+    static uint64_t lastTotal = 0;
+    uint64_t now = IdiNowMs();
+    uint64_t due = gIdiExec.statsNextMs.load(std::memory_order_relaxed);
+
+    if (now < due || !gIdiExec.statsNextMs.compare_exchange_strong(due, now + IDI_STATS_PERIOD_MS)) {
+        return;
+    }
+    T_IdiLaneStats stats[IdiLaneCount];
+    uint64_t total = 0;
+    IdiExecStatsGet(stats);
+    for (uint lane = 0; lane < IdiLaneCount; lane++) {
+        total += stats[lane].admitted + stats[lane].rejected;
+    }
+    if (total == lastTotal) {
+        return;
+    }
+    lastTotal = total;
+    for (uint lane = 0; lane < IdiLaneCount; lane++) {
+        info_printf("INFO: %s- %s lane: %u queued, %llu admitted, %llu rejected, average wait %u ms\n", 
+                        __FUNCTION__, gLaneNames[lane], stats[lane].queued, 
+                        (unsigned long long)stats[lane].admitted, (unsigned long long)stats[lane].rejected, 
+                        stats[lane].waitAvgMs);
+    }
+}
+
+
+/* IdiExecLaneDefaults: fill in the default lane weights and latency budgets */
+void IdiExecLaneDefaults(T_IdiLaneConf *pLanes)
+{
+    pLanes[IdiLaneWrite].weight = IDI_LANE_WRITE_WEIGHT;
+    pLanes[IdiLaneWrite].budgetMs = IDI_LANE_WRITE_BUDGET_MS;
+    pLanes[IdiLaneRead].weight = IDI_LANE_READ_WEIGHT;
+    pLanes[IdiLaneRead].budgetMs = IDI_LANE_READ_BUDGET_MS;
+    pLanes[IdiLaneLifecycle].weight = IDI_LANE_LIFECYCLE_WEIGHT;
+    pLanes[IdiLaneLifecycle].budgetMs = IDI_LANE_LIFECYCLE_BUDGET_MS;
+    for (uint lane = 0; lane < IdiLaneCount; lane++) {
+        pLanes[lane].limit = 0;
+        pLanes[lane].shedMs = 0;
+    }
+    pLanes[IdiLaneRead].shedMs = IDI_LANE_READ_SHED_MS;
+}
+
+
+/* IdiExecInit: allocate depth action slots, the shards and their rings.  pLanes */
+/* may be NULL for the default lane settings.                                   */
+int IdiExecInit(uint workerCount, uint depth, const T_IdiLaneConf *pLanes, 
+                T_IdiActionRunFn pfnRun, T_IdiActionRunFn pfnExpire)
+{
+    gIdiExec.depth = depth ? depth : IDI_ACT_Q_SIZE;
+    int retVal = IdiPoolInit(&gIdiExec.actPool, gIdiExec.depth, sizeof(IdiActionCB));
+    if (retVal != SUCCESS) {
+        err_printf("ERROR %s: failed to allocate %u action slots\n", __FUNCTION__, gIdiExec.depth);
+        return retVal;
+    }
+    gIdiExec.pfnRun = pfnRun;
+    gIdiExec.pfnExpire = pfnExpire;
+    IdiExecLaneDefaults(gIdiExec.lanes);
+    for (uint lane = 0; pLanes && lane < IdiLaneCount; lane++) {
+        gIdiExec.lanes[lane] = pLanes[lane];
+        if (gIdiExec.lanes[lane].weight == 0) {
+            gIdiExec.lanes[lane].weight = 1;    // a lane without weight would never be served
+        }
+    }
+    for (uint lane = 0; lane < IdiLaneCount; lane++) {
+        if (gIdiExec.lanes[lane].limit == 0 || gIdiExec.lanes[lane].limit > gIdiExec.depth) {
+            gIdiExec.lanes[lane].limit = gIdiExec.depth;
+        }
+    }
+    gIdiExec.statsNextMs.store(IdiNowMs() + IDI_STATS_PERIOD_MS, std::memory_order_relaxed);
+
+#ifdef IDI_USE_MQUEUE
+    // the mqueue fallback has a single queue and therefore a single worker
+    char qName[Q_NAME_LENGTH];
+    sprintf(qName, IDI_ACT_Q, CDNAME);
+    retVal = IdiCreateQueue(&gIdiExec.idiDevActQueue, qName, BLOCKING_Q, gIdiExec.depth, sizeof(IdiActionCB *));
+    if (retVal != SUCCESS) {
+        err_printf("ERROR %s: IdiCreateQueue %s failed\n", __FUNCTION__, qName);
+    } else {
+		info_printf("INFO: IdiCreateQueue %s successful\n", qName);
+    }
+    (void)workerCount;
+    workerCount = 1;
+#else
+    if (workerCount == 0) {
+        workerCount = 1;
+    } else if (workerCount > IDI_WORKERS_MAX) {
+        workerCount = IDI_WORKERS_MAX;
+    }
+    if (retVal == SUCCESS) {
+        retVal = IdiRingInit(&gIdiExec.lifecycleRing, gIdiExec.depth);
+    }
+    if (retVal == SUCCESS) {
+        retVal = IdiSchedInit(&gIdiExec.lifecycleSched);
+    }
+#endif
+
+    if (retVal == SUCCESS) {
+        gIdiExec.pShards = (T_IdiShard *)calloc(workerCount, sizeof(T_IdiShard));
+        if (gIdiExec.pShards == NULL) {
+            err_printf("ERROR %s: failed to allocate %u shards\n", __FUNCTION__, workerCount);
+            retVal = FAILURE;
+        }
+    }
+    for (uint i = 0; retVal == SUCCESS && i < workerCount; i++) {
+        T_IdiShard *pShard = &gIdiExec.pShards[i];
+        pShard->index = i;
+        pShard->completed.store(0, std::memory_order_relaxed);
+        retVal = IdiSchedInit(&pShard->sched);
+#ifndef IDI_USE_MQUEUE
+        // every ring can hold the whole pool, so a push never fails once a slot was obtained
+        for (uint lane = 0; retVal == SUCCESS && lane < IDI_SHARD_LANES; lane++) {
+            retVal = IdiRingInit(&pShard->lanes[lane], gIdiExec.depth);
+        }
+        if (retVal == SUCCESS) {
+            retVal = IdiDoorbellInit(&pShard->bell);
+        }
+#endif
+        gIdiExec.shardCount = i + 1;
+    }
+    if (retVal != SUCCESS) {
+        err_printf("ERROR %s: failed to create the action executor\n", __FUNCTION__);
+    } else {
+        info_printf("INFO: %s- action executor with %u worker(s)\n", __FUNCTION__, gIdiExec.shardCount);
+    }
+
+    return retVal;
+}
+
+
+#ifndef IDI_USE_MQUEUE
+/* IdiExecWakeAll: wake every sleeping worker, used for lifecycle actions anyone may take */
+static void IdiExecWakeAll(void)
+{
+    for (uint i = 0; i < gIdiExec.shardCount; i++) {
+        IdiDoorbellRing(&gIdiExec.pShards[i].bell);
+    }
+}
+#endif
+
+
+/* IdiExecReject: count an action that was turned away; the first one of a */
+/* row is logged so overload shows up before the queue runs full           */
+static void IdiExecReject(uint lane, const char *reason)
+{
+    T_IdiLaneStat *pStat = &gIdiExec.laneStat[lane];
+
+    pStat->rejected.fetch_add(1, std::memory_order_relaxed);
+    if (!pStat->bShedding.exchange(true, std::memory_order_relaxed)) {
+        err_printf("WARN: %s- %s lane turns actions away (%s): %u queued, average wait %u ms\n", 
+                        __FUNCTION__, gLaneNames[lane], reason, pStat->queued.load(std::memory_order_relaxed), 
+                        pStat->waitAvg.load(std::memory_order_relaxed) / IDI_WAIT_AVG_SCALE);
+    }
+}
+
+
+/* IdiExecLaneSlow: true when the actions of a lane wait longer than its shed */
+/* wait: on average lately, or the backlog being worked on right now         */
+static bool IdiExecLaneSlow(uint lane, uint queued)
+{
+    T_IdiLaneStat *pStat = &gIdiExec.laneStat[lane];
+    uint shedMs = gIdiExec.lanes[lane].shedMs;
+
+    if (shedMs == 0) {
+        return false;
+    }
+    if (pStat->waitAvg.load(std::memory_order_relaxed) > shedMs * IDI_WAIT_AVG_SCALE) {
+        return true;
+    }
+    // the action dequeued last is older than the one at the head, so this errs on the slow side
+    uint64_t headMs = pStat->headEnqueueMs.load(std::memory_order_relaxed);
+    return queued && headMs && IdiNowMs() > headMs + shedMs;
+}
+
+
+/* IdiExecAdmit: reserve a place for an action in its lane.  A lane at its limit, */
+/* or with a backlog that waits longer than its shed wait, turns the action       */
+/* away; the Idl retries it later.                                                */
+static bool IdiExecAdmit(uint lane)
+{
+    T_IdiLaneStat *pStat = &gIdiExec.laneStat[lane];
+
+    uint queued = pStat->queued.fetch_add(1, std::memory_order_relaxed);
+    if (queued >= gIdiExec.lanes[lane].limit) {
+        pStat->queued.fetch_sub(1, std::memory_order_relaxed);
+        IdiExecReject(lane, "limit");
+        return false;
+    }
+    bool bSlow = IdiExecLaneSlow(lane, queued);
+    // an empty lane always admits, which lets the average recover after a backlog
+    if (bSlow && queued) {
+        pStat->queued.fetch_sub(1, std::memory_order_relaxed);
+        IdiExecReject(lane, "wait");
+        return false;
+    }
+    if (!bSlow) {
+        pStat->bShedding.store(false, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+
+/* IdiExecPost: copy an action into a pool slot and queue its handle.  Returns */
+/* FAILURE (errno set) when the action's lane does not admit it or the         */
+/* executor is out of slots.                                                   */
+int IdiExecPost(const IdiActionCB& aCB)
+{
+    uint lane = IdiExecLaneOf(&aCB);
+    if (!IdiExecAdmit(lane)) {
+        errno = EBUSY;
+        return FAILURE;
+    }
+    IdiActionCB *pActCb = (IdiActionCB *)IdiPoolAlloc(&gIdiExec.actPool);
+    if (pActCb == NULL) {
+        gIdiExec.laneStat[lane].queued.fetch_sub(1, std::memory_order_relaxed);
+        IdiExecReject(lane, "out of slots");
+        errno = EAGAIN;
+        return FAILURE;
+    }
+    *pActCb = aCB;
+    memset(&pActCb->exec, 0, sizeof(pActCb->exec));
+    pActCb->exec.enqueueMs = IdiNowMs();
+    pActCb->exec.deadlineMs = pActCb->exec.enqueueMs + pActCb->timeout;
+    pActCb->exec.heapIdx = IDI_HEAP_NONE;
+    pActCb->exec.lane = lane;
+
+#ifdef IDI_USE_MQUEUE
+    // a single queue can not be weighted, the lanes become strict mqueue priorities
+    uint prio = IdiLaneCount - pActCb->exec.lane;
+    if (mq_send(gIdiExec.idiDevActQueue, (const char *)&pActCb, sizeof(pActCb), prio) != 0) {
+        gIdiExec.laneStat[lane].queued.fetch_sub(1, std::memory_order_relaxed);
+        IdiPoolRelease(&gIdiExec.actPool, pActCb);
+        return FAILURE;
+    }
+#else
+    T_IdiShard *pShard = IdiExecShardOf(pActCb->dev);
+    pActCb->exec.shard = pShard->index;
+    if (pActCb->exec.lane == IdiLaneLifecycle) {
+        // a delete must not overtake the datapoint actions already queued for its device
+        for (uint lane = 0; pActCb->action == IdiaDelete && lane < IDI_SHARD_LANES; lane++) {
+            pActCb->exec.barrier[lane] = IdiRingTicket(&pShard->lanes[lane]);
+        }
+        IdiRingPush(&gIdiExec.lifecycleRing, pActCb);
+        uint64_t expected = IDI_WAKE_NEVER;
+        gLifecycleHeadMs.compare_exchange_strong(expected, pActCb->exec.enqueueMs);
+        IdiExecWakeAll();
+    } else {
+        IdiRingPush(&pShard->lanes[pActCb->exec.lane], pActCb);
+        IdiDoorbellRing(&pShard->bell);
+    }
+#endif
+    return SUCCESS;
+}
+
+
+/* IdiExecResume: ask for a parked action to be retried now rather than at its  */
+/* wake time, typically when the I/O it was waiting for completed.  May be      */
+/* called from any thread while the action has not completed yet.              */
+int IdiExecResume(IdiActionCB *pActCb)
+{
+    int expected = IdiSchedParked;
+
+    if (!__atomic_compare_exchange_n(&pActCb->exec.state, &expected, IdiSchedResumed, false, 
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if (expected == IdiSchedRunning) {
+            // still running: IdiSchedPark will notice and retry right away
+            __atomic_compare_exchange_n(&pActCb->exec.state, &expected, IdiSchedResumed, false, 
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+        return SUCCESS;
+    }
+#ifdef IDI_USE_MQUEUE
+    IdiRingPush(&gIdiExec.pShards[0].sched.resumeRing, pActCb);
+    // a null handle only wakes the worker up; if the queue is full it is awake anyway
+    IdiActionCB *pWakeup = NULL;
+    struct timespec ts = {0, 0};
+    mq_timedsend(gIdiExec.idiDevActQueue, (const char *)&pWakeup, sizeof(pWakeup), 1, &ts);
+#else
+    if (pActCb->exec.lane == IdiLaneLifecycle) {
+        IdiRingPush(&gIdiExec.lifecycleSched.resumeRing, pActCb);
+        IdiExecWakeAll();
+    } else {
+        T_IdiShard *pShard = &gIdiExec.pShards[pActCb->exec.shard];
+        IdiRingPush(&pShard->sched.resumeRing, pActCb);
+        IdiDoorbellRing(&pShard->bell);
+    }
+#endif
+    return SUCCESS;
+}
+
+
+#ifndef IDI_USE_MQUEUE
+/* IdiExecBarrierPassed: true once a delete may run: its shard dequeued every */
+/* datapoint action queued before it and none of them is still parked or      */
+/* waiting.  Only the worker of that shard can tell.                          */
+static bool IdiExecBarrierPassed(const IdiActionCB *pActCb, T_IdiShard *pShard)
+{
+    if (pActCb->action != IdiaDelete) {
+        return true;
+    }
+    if (pActCb->exec.shard != pShard->index) {
+        return false;
+    }
+    for (uint lane = 0; lane < IDI_SHARD_LANES; lane++) {
+        if (!IdiRingPassed(&pShard->lanes[lane], pActCb->exec.barrier[lane])) {
+            return false;
+        }
+    }
+    return IdiGateFind(&pShard->sched, pActCb->dev) == NULL;
+}
+
+
+/* IdiExecRunLifecycle: take the lifecycle lane if no other worker owns it and */
+/* run one action.  Returns true when an action was run.                      */
+static bool IdiExecRunLifecycle(T_IdiShard *pShard)
+{
+    T_IdiSched *pSched = &gIdiExec.lifecycleSched;
+    bool bRan = false;
+    int expected = 0;
+
+    if (!gLifecycleBusy.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+        return false;   // the owner keeps going until the lifecycle work is done
+    }
+    bRan = IdiSchedPoll(pSched, NULL);
+
+    T_IdiShard *pWake = NULL;
+    IdiActionCB *pActCb = gIdiExec.pStalled;
+    if (pActCb || IdiRingPop(&gIdiExec.lifecycleRing, (void **)&pActCb)) {
+        if (IdiExecBarrierPassed(pActCb, pShard)) {
+            gIdiExec.pStalled = NULL;
+            gStalledShard.store(-1, std::memory_order_release);
+            IdiSchedAdmit(pSched, NULL, pActCb);
+            bRan = true;
+        } else if (gIdiExec.pStalled == NULL) {
+            // hold it; its shard's worker picks it up as soon as the barrier is passed
+            gIdiExec.pStalled = pActCb;
+            gStalledShard.store(pActCb->exec.shard, std::memory_order_release);
+            pWake = &gIdiExec.pShards[pActCb->exec.shard];
+        }
+    }
+    IdiActionCB *pHead = NULL;
+    gLifecycleHeadMs.store(IdiRingPeek(&gIdiExec.lifecycleRing, (void **)&pHead) ? pHead->exec.enqueueMs : IDI_WAKE_NEVER);
+    gLifecycleWakeMs.store(IdiSchedNextWake(pSched), std::memory_order_relaxed);
+    gLifecycleBusy.store(0, std::memory_order_release);
+    if (pWake && pWake != pShard) {
+        // only once the lane is released, or the worker would find it busy and sleep again
+        IdiDoorbellRing(&pWake->bell);
+    }
+
+    return bRan;
+}
+
+
+/* IdiExecLifecycleReady: true when this worker could make progress on the lifecycle lane */
+static bool IdiExecLifecycleReady(T_IdiShard *pShard)
+{
+    if (gLifecycleBusy.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (!IdiRingIsEmpty(&gIdiExec.lifecycleSched.resumeRing) || 
+        gLifecycleWakeMs.load(std::memory_order_relaxed) <= IdiNowMs()) {
+        return true;
+    }
+    int stalled = gStalledShard.load(std::memory_order_acquire);
+    if (stalled >= 0) {
+        return (uint)stalled == pShard->index && IdiExecBarrierPassed(gIdiExec.pStalled, pShard);
+    }
+    return !IdiRingIsEmpty(&gIdiExec.lifecycleRing);
+}
+
+
+/* IdiExecLaneReady: true when the lane has an action this worker can take */
+static bool IdiExecLaneReady(T_IdiShard *pShard, uint lane)
+{
+    if (lane == IdiLaneLifecycle) {
+        return IdiExecLifecycleReady(pShard);
+    }
+    return !IdiRingIsEmpty(&pShard->lanes[lane]);
+}
+
+
+/* IdiExecLaneOverdue: true when the oldest action of a lane has been waiting */
+/* longer than the lane's latency budget                                     */
+static bool IdiExecLaneOverdue(T_IdiShard *pShard, uint lane, uint64_t now)
+{
+    uint64_t headMs = IDI_WAKE_NEVER;
+    IdiActionCB *pHead = NULL;
+
+    if (lane == IdiLaneLifecycle) {
+        // kept by the lifecycle owner, good enough for a scheduling hint
+        headMs = gLifecycleHeadMs.load(std::memory_order_relaxed);
+    } else if (IdiRingPeek(&pShard->lanes[lane], (void **)&pHead)) {
+        headMs = pHead->exec.enqueueMs;
+    }
+    return headMs != IDI_WAKE_NEVER && now > headMs + gIdiExec.lanes[lane].budgetMs;
+}
+
+
+/* IdiExecPickLane: choose the lane to serve next.  The lanes take turns, each */
+/* taking up to its weight in actions per round.  A lane over its latency      */
+/* budget jumps the queue, writes before reads before lifecycle actions, but   */
+/* only every other pick so a lane that stays overloaded can not starve the    */
+/* others.  Returns IdiLaneCount when there is nothing to do.                  */
+static uint IdiExecPickLane(T_IdiShard *pShard)
+{
+    uint64_t now = IdiNowMs();
+
+    for (uint lane = 0; !pShard->bJumped && lane < IdiLaneCount; lane++) {
+        if (IdiExecLaneOverdue(pShard, lane, now) && IdiExecLaneReady(pShard, lane)) {
+            if (pShard->credit[lane]) {
+                pShard->credit[lane]--;
+            }
+            pShard->bJumped = true;
+            return lane;
+        }
+    }
+    pShard->bJumped = false;
+    for (uint round = 0; round < 2; round++) {
+        for (uint i = 0; i < IdiLaneCount; i++) {
+            uint lane = (pShard->cursor + i) % IdiLaneCount;
+            if (pShard->credit[lane] && IdiExecLaneReady(pShard, lane)) {
+                pShard->cursor = lane;
+                pShard->credit[lane]--;
+                return lane;
+            }
+        }
+        // every lane with work used up its share: start a new round
+        for (uint lane = 0; lane < IdiLaneCount; lane++) {
+            pShard->credit[lane] = gIdiExec.lanes[lane].weight;
+        }
+    }
+    return IdiLaneCount;
+}
+
+
+/* IdiExecServeLane: run a batch of actions from a lane, as many as are ready up */
+/* to IDI_BATCH_MAX and the lane's credit.  Returns true if there was one.      */
+static bool IdiExecServeLane(T_IdiShard *pShard, uint lane)
+{
+    IdiActionCB *batch[IDI_BATCH_MAX];
+    uint count = 0;
+
+    if (lane == IdiLaneLifecycle) {
+        return IdiExecRunLifecycle(pShard);
+    }
+    // the first action was paid for by IdiExecPickLane, the others take from the credit
+    while (count < IDI_BATCH_MAX && (count == 0 || pShard->credit[lane]) &&
+           IdiRingPop(&pShard->lanes[lane], (void **)&batch[count])) {
+        if (count++) {
+            pShard->credit[lane]--;
+        }
+    }
+    IdiSchedAdmitBatch(&pShard->sched, pShard, batch, count);
+
+    return count != 0;
+}
+
+
+/* IdiExecSleepMs: how long a worker may sleep before a parked action is due */
+static int IdiExecSleepMs(T_IdiShard *pShard)
+{
+    uint64_t wake = IdiSchedNextWake(&pShard->sched);
+    uint64_t lifecycleWake = gLifecycleWakeMs.load(std::memory_order_relaxed);
+
+    if (lifecycleWake < wake) {
+        wake = lifecycleWake;
+    }
+    if (wake == IDI_WAKE_NEVER) {
+        return -1;
+    }
+    uint64_t now = IdiNowMs();
+    return (wake > now) ? (int)(wake - now) : 0;
+}
+
+
+/* IdiExecStep: one pass of a worker over its shard: retry what is due, then */
+/* serve one lane.  Returns true when anything was run.                      */
+static bool IdiExecStep(T_IdiShard *pShard)
+{
+    IdiExecStatsTick();
+    bool bBusy = IdiSchedPoll(&pShard->sched, pShard);
+    uint lane = IdiExecPickLane(pShard);
+    if (lane != IdiLaneCount && IdiExecServeLane(pShard, lane)) {
+        bBusy = true;
+    }
+    return bBusy;
+}
+
+
+/* IdiExecSleepBegin: announce the worker of a shard is going to sleep.  Returns */
+/* 0 when there is work after all (the sleep is called off), otherwise how long  */
+/* it may sleep in ms, -1 for until its doorbell rings.                          */
+static int IdiExecSleepBegin(T_IdiShard *pShard)
+{
+    IdiDoorbellPrepare(&pShard->bell);
+    if (!IdiRingIsEmpty(&pShard->lanes[IdiLaneWrite]) || !IdiRingIsEmpty(&pShard->lanes[IdiLaneRead]) ||
+        !IdiRingIsEmpty(&pShard->sched.resumeRing) || IdiExecLifecycleReady(pShard)) {
+        IdiDoorbellCancel(&pShard->bell);
+        return 0;
+    }
+    int sleepMs = IdiExecSleepMs(pShard);
+    if (sleepMs == 0) {
+        IdiDoorbellCancel(&pShard->bell);
+    }
+    return sleepMs;
+}
+
+
+/* IdiExecShardServe: run one pass over a shard from an external event loop; */
+/* returns true when anything was run                                        */
+bool IdiExecShardServe(uint index)
+{
+    return IdiExecStep(&gIdiExec.pShards[index]);
+}
+
+
+/* IdiExecShardSleep: called by an external event loop before it blocks, see */
+/* IdiExecSleepBegin.  The loop polls IdiExecShardFd for the wakeup and calls */
+/* IdiExecShardWoken once it no longer sleeps.                                */
+int IdiExecShardSleep(uint index)
+{
+    return IdiExecSleepBegin(&gIdiExec.pShards[index]);
+}
+
+
+/* IdiExecShardWoken: the event loop that slept for a shard is back */
+void IdiExecShardWoken(uint index)
+{
+    IdiDoorbellAck(&gIdiExec.pShards[index].bell);
+}
+
+
+/* IdiExecShardFd: file descriptor that becomes readable when a shard has work */
+int IdiExecShardFd(uint index)
+{
+    return gIdiExec.pShards[index].bell.efd;
+}
+#endif
+
+
+/* IdiExecWorker: worker thread serving one shard plus the shared lifecycle lane */
+static void *IdiExecWorker(void *pvArg)
+{
+    T_IdiShard *pShard = (T_IdiShard *)pvArg;
+    char name[16];
+
+    snprintf(name, sizeof(name), "IdiWorker%u", pShard->index);
+    pthread_setname_np(pthread_self(), name);       // <= 16 chars
+
+    while (__atomic_load_n(&gIdiExec.stat, __ATOMIC_ACQUIRE) != IdiStop) {
+#ifdef IDI_USE_MQUEUE
+        IdiExecStatsTick();
+        IdiActionCB *pActCb = NULL;
+        IdiSchedPoll(&pShard->sched, pShard);
+
+        struct timespec ts;
+        uint64_t wake = IdiSchedNextWake(&pShard->sched);
+        ssize_t rc;
+        if (wake == IDI_WAKE_NEVER) {
+            rc = mq_receive(gIdiExec.idiDevActQueue, (char *)&pActCb, sizeof(pActCb), NULL);
+        } else {
+            uint64_t now = IdiNowMs();
+            uint64_t delayMs = (wake > now) ? wake - now : 0;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += delayMs / 1000;
+            ts.tv_nsec += (delayMs % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            rc = mq_timedreceive(gIdiExec.idiDevActQueue, (char *)&pActCb, sizeof(pActCb), NULL, &ts);
+        }
+        if (rc == -1) {
+            continue;
+        }
+        // drain what else is ready without blocking; NULL handles only wake the worker up
+        IdiActionCB *batch[IDI_BATCH_MAX];
+        uint count = 0;
+        ts = (struct timespec){0, 0};
+        do {
+            if (pActCb) {
+                batch[count++] = pActCb;
+            }
+        } while (count < IDI_BATCH_MAX &&
+                 mq_timedreceive(gIdiExec.idiDevActQueue, (char *)&pActCb, sizeof(pActCb), NULL, &ts) != -1);
+        IdiSchedAdmitBatch(&pShard->sched, pShard, batch, count);
+#else
+        if (!IdiExecStep(pShard)) {
+            int sleepMs = IdiExecSleepBegin(pShard);
+            if (sleepMs != 0) {
+                IdiDoorbellWait(&pShard->bell, sleepMs);
+            }
+        }
+#endif
+    }
+
+    return NULL;
+}
+
+
+/* IdiExecStart: start the workers of every shard but shard 0, which is served */
+/* by IdiExecRun or an event loop.  Called before any action is posted, as a   */
+/* shard without its worker would never run the actions routed to it.         */
+int IdiExecStart(void)
+{
+    gIdiExec.stat = IdiRunning;
+    for (uint i = 1; i < gIdiExec.shardCount; i++) {
+        T_IdiShard *pShard = &gIdiExec.pShards[i];
+        int rc = pthread_create(&pShard->thread, NULL, IdiExecWorker, pShard);
+        if (rc != 0) {
+            err_printf("ERROR: %s- Failed to create worker %u (rc: %d)\n", __FUNCTION__, i, rc);
+            // stop the workers started so far, the shards from i on have none to join
+            gIdiExec.shardCount = i;
+            IdiExecStop();
+            return FAILURE;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+/* IdiExecStop: tell the workers to stop and wait for those IdiExecStart started */
+/* to finish the action they run.  Shard 0's caller returns from IdiExecRun or   */
+/* its event loop by itself.                                                     */
+void IdiExecStop(void)
+{
+    if (__atomic_load_n(&gIdiExec.stat, __ATOMIC_ACQUIRE) != IdiRunning) {
+        return;
+    }
+    __atomic_store_n(&gIdiExec.stat, IdiStop, __ATOMIC_RELEASE);
+#ifdef IDI_USE_MQUEUE
+    // NULL handles only wake the workers up; with the queue full they are awake anyway
+    IdiActionCB *pActCb = NULL;
+    struct timespec ts = {0, 0};
+    for (uint i = 0; i < gIdiExec.shardCount; i++) {
+        mq_timedsend(gIdiExec.idiDevActQueue, (const char *)&pActCb, sizeof(pActCb), 0, &ts);
+    }
+#else
+    IdiExecWakeAll();
+#endif
+    for (uint i = 1; i < gIdiExec.shardCount; i++) {
+        pthread_join(gIdiExec.pShards[i].thread, NULL);
+    }
+}
+
+
+/* IdiExecRunning: false once the executor was told to stop */
+bool IdiExecRunning(void)
+{
+    return __atomic_load_n(&gIdiExec.stat, __ATOMIC_ACQUIRE) != IdiStop;
+}
+
+
+/* IdiExecRun: serve shard 0 in the calling thread, after IdiExecStart */
+void IdiExecRun(void)
+{
+    IdiExecWorker(&gIdiExec.pShards[0]);
+}
@@ -0,0 +1,170 @@
+//
+// idiexec.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// Device action executor: a pool of worker threads, one shard per worker.
+// Datapoint actions are routed to a shard by device handle and queued on its read
+// or write lane; lifecycle actions go to a shared lane that is served by one
+// worker at a time.  Workers take turns between the lanes by weight, taking a
+// batch of ready actions per turn that is run grouped by device, and a lane
+// whose oldest action is over its latency budget goes first.  An action
+// reporting IErr_IdiBusy is parked until its retry time or IdiExecResume and the
+// worker moves on; later actions of the same device wait behind it.  Admission
+// is per lane: a lane that holds its limit, or whose actions have lately waited
+// longer than its shed wait while it still has a backlog, turns new actions away.
+//
+
+#ifndef IDIEXEC_H
+#define IDIEXEC_H
+
+#include "example.h"
+
+#ifndef IDI_WORKERS
+#define IDI_WORKERS             4       // number of action worker threads
+#endif
+#define IDI_WORKERS_MAX         32
+#define IDI_BUSY_RETRY_MIN_MS   1       // first retry of an action that reported IErr_IdiBusy
+#define IDI_BUSY_RETRY_MAX_MS   64      // retry interval backs off up to this value
+#define IDI_GATE_INIT_SIZE      256     // initial size of the per scheduler device gate table
+#ifndef IDI_BATCH_MAX
+#define IDI_BATCH_MAX           16      // actions a worker dequeues from a lane per wakeup
+#endif
+
+// Default lane weights (actions per round) and latency budgets
+#define IDI_LANE_WRITE_WEIGHT       8
+#define IDI_LANE_WRITE_BUDGET_MS    20
+#define IDI_LANE_READ_WEIGHT        4
+#define IDI_LANE_READ_BUDGET_MS     200
+#define IDI_LANE_LIFECYCLE_WEIGHT   1
+#define IDI_LANE_LIFECYCLE_BUDGET_MS 5000
+#define IDI_LANE_READ_SHED_MS       400     // a read that waited this long is unlikely to make its deadline
+#define IDI_STATS_PERIOD_MS         60000   // lane counters are logged this often while there is traffic
+
+
+typedef int (*T_IdiActionRunFn)(IdiActionCB& aCB);
+
+typedef struct _IdiLaneConf {
+    uint weight;                            // actions a lane may take in a row per round
+    uint budgetMs;                          // queueing delay after which the lane goes first
+    uint limit;                             // actions the lane may hold, 0 for the queue depth
+    uint shedMs;                            // average queueing delay above which new actions are
+                                            // turned away while the lane has a backlog, 0 never
+} T_IdiLaneConf;
+
+// Admission counters of one lane
+typedef struct _IdiLaneStats {
+    uint queued;                            // posted, not dequeued yet
+    uint64_t admitted;                      // dequeued since start
+    uint64_t rejected;                      // turned away since start
+    uint waitAvgMs;                         // moving average of the queueing delay
+} T_IdiLaneStats;
+
+typedef struct _IdiLaneStat {
+    std::atomic<uint> queued;
+    std::atomic<uint64_t> admitted;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint> waitAvg;              // queueing delay in ms, scaled by IDI_WAIT_AVG_SCALE
+    std::atomic<uint64_t> headEnqueueMs;    // enqueue time of the action dequeued last
+    std::atomic<bool> bShedding;            // last action posted to the lane was turned away
+} T_IdiLaneStat;
+
+typedef enum {
+    IdiSchedQueued = 0,                     // in a ring, not run yet
+    IdiSchedRunning,                        // owned by a worker
+    IdiSchedParked,                         // busy, waiting for its wake time or IdiExecResume
+    IdiSchedResumed                         // IdiExecResume queued it for an early retry
+} IdiSchedState;
+
+// Actions of one device that wait behind an action of that device that is parked
+typedef struct _IdiGate {
+    IdlDev *dev;
+    IdiActionCB *pWaitHead;
+    IdiActionCB *pWaitTail;
+} T_IdiGate;
+
+// Parked actions (min-heap on wake time), device gates and action deadlines of one scheduler.
+// Each shard has one, the lifecycle ring has one; only its owner touches it.
+typedef struct _IdiSched {
+    T_IdiRing resumeRing;                   // parked actions IdiExecResume wants retried now
+    IdiActionCB **ppHeap;
+    uint heapCount;
+    uint heapSize;
+    T_IdiGate *pGates;
+    uint gateCount;
+    uint gateSize;
+    T_IdiWheel wheel;                       // deadlines of the actions admitted here
+} T_IdiSched;
+
+typedef struct _IdiShard {
+    T_IdiRing lanes[IDI_SHARD_LANES];       // datapoint actions of the devices hashed to this shard
+    T_IdiDoorbell bell;                     // wakes this shard's worker
+    T_IdiSched sched;
+    std::atomic<uint64_t> completed;        // actions this worker finished
+    uint credit[IdiLaneCount];              // actions each lane may still take this round
+    uint cursor;                            // lane being served
+    bool bJumped;                           // last lane was picked for being over budget
+    uint index;
+    pthread_t thread;
+} T_IdiShard;
+
+typedef struct _IdiExec {
+    uint shardCount;
+    T_IdiShard *pShards;
+    T_IdiPool actPool;                      // preallocated IdiActionCB slots; queues carry handles to them
+    T_IdiActionRunFn pfnRun;                // runs one step, returns IErr_IdiBusy to be retried later
+    T_IdiActionRunFn pfnExpire;             // completes an action whose deadline passed
+    uint depth;                             // actions that may be queued or running at a time
+    T_IdiLaneConf lanes[IdiLaneCount];
+    T_IdiLaneStat laneStat[IdiLaneCount];
+    std::atomic<uint64_t> statsNextMs;      // when the lane counters are logged next
+    IdiStatus stat;
+#ifdef IDI_USE_MQUEUE
+    mqd_t idiDevActQueue;                   // message Queue for sending pending device actions to the worker
+#else
+    T_IdiRing lifecycleRing;                // device lifecycle actions, served by any idle worker
+    T_IdiSched lifecycleSched;
+    IdiActionCB *pStalled;                  // lifecycle action waiting for its shard to drain
+#endif
+} T_IdiExec;
+
+
+extern uint64_t IdiNowMs(void);
+extern const char *IdiExecLaneName(uint lane);
+extern void IdiExecLaneDefaults(T_IdiLaneConf *pLanes);
+extern int IdiExecInit(uint workerCount, uint depth, const T_IdiLaneConf *pLanes, 
+                       T_IdiActionRunFn pfnRun, T_IdiActionRunFn pfnExpire);
+extern int IdiExecPost(const IdiActionCB& aCB);
+extern int IdiExecResume(IdiActionCB *pActCb);
+extern int IdiExecStart(void);
+extern void IdiExecStop(void);
+extern bool IdiExecRunning(void);
+extern void IdiExecRun(void);
+#ifndef IDI_USE_MQUEUE
+extern bool IdiExecShardServe(uint index);
+extern int IdiExecShardSleep(uint index);
+extern void IdiExecShardWoken(uint index);
+extern int IdiExecShardFd(uint index);
+#endif
+extern void IdiExecStatsGet(T_IdiLaneStats *pStats);
+
+#endif
@@ -0,0 +1,208 @@
+//
+// idiindex.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Device storage index by unid
+//
+
+#include "common.h"
+
+
+/* IdiIndexHash: FNV-1a hash of a unid */
+static uint32_t IdiIndexHash(const char *unid)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*unid) {
+        hash ^= (uint8_t)*unid++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/* IdiIndexPlace: put a device in the first free slot of its probe sequence */
+static void IdiIndexPlace(T_IdiDevSlot *pSlots, uint mask, uint32_t hash, T__DevStoPtr pDevSto)
+{
+    uint i = hash & mask;
+
+    while (pSlots[i].pDevSto) {
+        i = (i + 1) & mask;
+    }
+    pSlots[i].hash = hash;
+    pSlots[i].pDevSto = pDevSto;
+}
+
+
+/* IdiIndexGrow: double the slot table, rehashing every device into it */
+static int IdiIndexGrow(T_IdiDevIndex *pIndex)
+{
+    uint mask = pIndex->mask * 2 + 1;
+    T_IdiDevSlot *pSlots = (T_IdiDevSlot *)calloc(mask + 1, sizeof(T_IdiDevSlot));
+
+    if (pSlots == NULL) {
+        err_printf("ERROR: %s- failed to allocate %u index slots\n", __FUNCTION__, mask + 1);
+        return FAILURE;
+    }
+    for (uint i = 0; i <= pIndex->mask; i++) {
+        if (pIndex->pSlots[i].pDevSto) {
+            IdiIndexPlace(pSlots, mask, pIndex->pSlots[i].hash, pIndex->pSlots[i].pDevSto);
+        }
+    }
+    free(pIndex->pSlots);
+    pIndex->pSlots = pSlots;
+    pIndex->mask = mask;
+
+    return SUCCESS;
+}
+
+
+/* IdiIndexInsertLocked: index a device under its current devUid, write lock held */
+static int IdiIndexInsertLocked(T_IdiDevIndex *pIndex, T__DevStoPtr pDevSto)
+{
+    // keep the load factor at or below 1/2 so probe sequences stay short
+    if ((pIndex->count + 1) * 2 > pIndex->mask + 1 && IdiIndexGrow(pIndex) != SUCCESS) {
+        return FAILURE;
+    }
+    IdiIndexPlace(pIndex->pSlots, pIndex->mask, IdiIndexHash(pDevSto->devUid), pDevSto);
+    pIndex->count++;
+
+    return SUCCESS;
+}
+
+
+/* IdiIndexRemoveLocked: drop a device from the index, write lock held.  The slots */
+/* after it in the same probe run move back so no tombstones are needed.          */
+static void IdiIndexRemoveLocked(T_IdiDevIndex *pIndex, T__DevStoPtr pDevSto)
+{
+    T_IdiDevSlot *pSlots = pIndex->pSlots;
+    uint mask = pIndex->mask;
+    uint i = IdiIndexHash(pDevSto->devUid) & mask;
+
+    while (pSlots[i].pDevSto != pDevSto) {
+        if (pSlots[i].pDevSto == NULL) {
+            return;     // not indexed
+        }
+        i = (i + 1) & mask;
+    }
+    pSlots[i].pDevSto = NULL;
+    pIndex->count--;
+
+    for (uint j = (i + 1) & mask; pSlots[j].pDevSto; j = (j + 1) & mask) {
+        uint home = pSlots[j].hash & mask;
+        // move j into the hole at i unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            pSlots[i] = pSlots[j];
+            pSlots[j].pDevSto = NULL;
+            i = j;
+        }
+    }
+}
+
+
+/* IdiIndexInit: create an index with room for capacity devices before it grows */
+int IdiIndexInit(T_IdiDevIndex *pIndex, uint capacity)
+{
+    uint slots = IDI_INDEX_MIN_SLOTS;
+
+    while (slots < capacity * 2) {
+        slots <<= 1;
+    }
+    pIndex->pSlots = (T_IdiDevSlot *)calloc(slots, sizeof(T_IdiDevSlot));
+    if (pIndex->pSlots == NULL) {
+        err_printf("ERROR: %s- failed to allocate %u index slots\n", __FUNCTION__, slots);
+        return FAILURE;
+    }
+    pIndex->mask = slots - 1;
+    pIndex->count = 0;
+    pthread_rwlock_init(&pIndex->lock, NULL);
+
+    return SUCCESS;
+}
+
+
+/* IdiIndexInsert: index a device under its devUid */
+int IdiIndexInsert(T_IdiDevIndex *pIndex, T__DevStoPtr pDevSto)
+{
+    pthread_rwlock_wrlock(&pIndex->lock);
+    int rc = IdiIndexInsertLocked(pIndex, pDevSto);
+    pthread_rwlock_unlock(&pIndex->lock);
+
+    return rc;
+}
+
+
+/* IdiIndexRemove: drop a device from the index.  Handlers that found it before */
+/* still use it, its storage has to be retired through IdiEbrRetire.            */
+void IdiIndexRemove(T_IdiDevIndex *pIndex, T__DevStoPtr pDevSto)
+{
+    pthread_rwlock_wrlock(&pIndex->lock);
+    IdiIndexRemoveLocked(pIndex, pDevSto);
+    pthread_rwlock_unlock(&pIndex->lock);
+}
+
+
+/* IdiIndexRekey: change a device's devUid and move it to the matching slot */
+int IdiIndexRekey(T_IdiDevIndex *pIndex, T__DevStoPtr pDevSto, const char *unid)
+{
+    pthread_rwlock_wrlock(&pIndex->lock);
+    IdiIndexRemoveLocked(pIndex, pDevSto);
+    strncpy(pDevSto->devUid, unid, sizeof(pDevSto->devUid));
+    pDevSto->devUid[MAX_UNID_CHARS] = '\0';     // forced string termination
+    int rc = IdiIndexInsertLocked(pIndex, pDevSto);
+    pthread_rwlock_unlock(&pIndex->lock);
+
+    return rc;
+}
+
+
+/* IdiIndexReadLock: hold off index changes while looking up devices */
+void IdiIndexReadLock(T_IdiDevIndex *pIndex)
+{
+    pthread_rwlock_rdlock(&pIndex->lock);
+}
+
+
+/* IdiIndexReadUnlock: done looking up devices */
+void IdiIndexReadUnlock(T_IdiDevIndex *pIndex)
+{
+    pthread_rwlock_unlock(&pIndex->lock);
+}
+
+
+/* IdiIndexFind: device storage with the given unid, NULL if none.  The caller */
+/* holds the read lock for the lookup and an epoch section while using it.     */
+T__DevStoPtr IdiIndexFind(T_IdiDevIndex *pIndex, const char *unid)
+{
+    uint32_t hash = IdiIndexHash(unid);
+    uint i = hash & pIndex->mask;
+
+    for (T_IdiDevSlot *pSlot = &pIndex->pSlots[i]; pSlot->pDevSto; pSlot = &pIndex->pSlots[i]) {
+        if (pSlot->hash == hash && strcmp(pSlot->pDevSto->devUid, unid) == 0) {
+            return pSlot->pDevSto;
+        }
+        i = (i + 1) & pIndex->mask;
+    }
+    return NULL;
+}
@@ -0,0 +1,64 @@
+//
+// idiindex.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Index of the device storage by unid: an open addressing hash table with linear
+// probing.  Lookups from the ETI event handler take the read lock, device create,
+// replace and delete take the write lock.  A device found is used inside an epoch
+// section (idiebr.h), a deleted device's storage is freed once those are left.
+//
+
+#ifndef IDIINDEX_H
+#define IDIINDEX_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define IDI_INDEX_MIN_SLOTS     16
+
+struct _DevSto;
+
+typedef struct _IdiDevSlot {
+    uint32_t hash;                          // hash of the device's unid
+    struct _DevSto *pDevSto;                // NULL for a free slot
+} T_IdiDevSlot;
+
+typedef struct _IdiDevIndex {
+    T_IdiDevSlot *pSlots;
+    uint mask;                              // slot count - 1
+    uint count;                             // devices indexed
+    pthread_rwlock_t lock;
+} T_IdiDevIndex;
+
+
+extern int IdiIndexInit(T_IdiDevIndex *pIndex, uint capacity);
+extern int IdiIndexInsert(T_IdiDevIndex *pIndex, struct _DevSto *pDevSto);
+extern void IdiIndexRemove(T_IdiDevIndex *pIndex, struct _DevSto *pDevSto);
+extern int IdiIndexRekey(T_IdiDevIndex *pIndex, struct _DevSto *pDevSto, const char *unid);
+extern void IdiIndexReadLock(T_IdiDevIndex *pIndex);
+extern void IdiIndexReadUnlock(T_IdiDevIndex *pIndex);
+extern struct _DevSto *IdiIndexFind(T_IdiDevIndex *pIndex, const char *unid);
+
+#endif
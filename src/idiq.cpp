@@ -0,0 +1,348 @@
+//
+// idiq.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// In-process action ring, doorbell and object pool
+//
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+
+
+/* IdiRingInit: initialize a ring able to hold at least size handles */
+int IdiRingInit(T_IdiRing *pRing, uint size)
+{
+    size_t cells = 2;
+
+    while (cells < size) {
+        cells <<= 1;
+    }
+    pRing->pCells = (T_IdiRingCell *)calloc(cells, sizeof(T_IdiRingCell));
+    if (pRing->pCells == NULL) {
+        err_printf("ERROR: %s- failed to allocate %zu ring cells\n", __FUNCTION__, cells);
+        return FAILURE;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        pRing->pCells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    pRing->mask = cells - 1;
+    pRing->head.store(0, std::memory_order_relaxed);
+    pRing->tail.store(0, std::memory_order_release);
+
+    return SUCCESS;
+}
+
+
+/* IdiRingFree: release the ring cells; the ring must no longer be in use */
+void IdiRingFree(T_IdiRing *pRing)
+{
+    IdlMemFree(pRing->pCells);
+    pRing->pCells = NULL;
+}
+
+
+/* IdiRingPush: enqueue a handle, returns false when the ring is full */
+bool IdiRingPush(T_IdiRing *pRing, void *pData)
+{
+    T_IdiRingCell *pCell;
+    size_t pos = pRing->head.load(std::memory_order_relaxed);
+
+    for (;;) {
+        pCell = &pRing->pCells[pos & pRing->mask];
+        size_t seq = pCell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (pRing->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false;       // full
+        } else {
+            pos = pRing->head.load(std::memory_order_relaxed);
+        }
+    }
+    pCell->pData = pData;
+    pCell->seq.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+/* IdiRingPop: dequeue a handle, returns false when the ring is empty */
+bool IdiRingPop(T_IdiRing *pRing, void **ppData)
+{
+    T_IdiRingCell *pCell;
+    size_t pos = pRing->tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+        pCell = &pRing->pCells[pos & pRing->mask];
+        size_t seq = pCell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (pRing->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false;       // empty
+        } else {
+            pos = pRing->tail.load(std::memory_order_relaxed);
+        }
+    }
+    *ppData = pCell->pData;
+    pCell->seq.store(pos + pRing->mask + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+/* IdiRingIsEmpty: true when no handle is ready at the tail of the ring */
+bool IdiRingIsEmpty(T_IdiRing *pRing)
+{
+    size_t pos = pRing->tail.load(std::memory_order_acquire);
+    size_t seq = pRing->pCells[pos & pRing->mask].seq.load(std::memory_order_acquire);
+
+    return (intptr_t)seq - (intptr_t)(pos + 1) < 0;
+}
+
+
+/* IdiRingCount: approximate number of queued handles */
+size_t IdiRingCount(T_IdiRing *pRing)
+{
+    size_t head = pRing->head.load(std::memory_order_relaxed);
+    size_t tail = pRing->tail.load(std::memory_order_relaxed);
+
+    return (head > tail) ? head - tail : 0;
+}
+
+
+/* IdiRingPeek: look at the handle at the tail without dequeuing it.  Only valid */
+/* for the single consumer of a ring.                                           */
+bool IdiRingPeek(T_IdiRing *pRing, void **ppData)
+{
+    size_t pos = pRing->tail.load(std::memory_order_relaxed);
+    T_IdiRingCell *pCell = &pRing->pCells[pos & pRing->mask];
+
+    if ((intptr_t)pCell->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0) {
+        return false;
+    }
+    *ppData = pCell->pData;
+    return true;
+}
+
+
+/* IdiRingTicket: position after every handle whose push has completed so far */
+size_t IdiRingTicket(T_IdiRing *pRing)
+{
+    return pRing->head.load(std::memory_order_acquire);
+}
+
+
+/* IdiRingPassed: true once every handle before ticket was dequeued */
+bool IdiRingPassed(T_IdiRing *pRing, size_t ticket)
+{
+    return (intptr_t)(pRing->tail.load(std::memory_order_acquire) - ticket) >= 0;
+}
+
+
+/* IdiDoorbellInit: create the eventfd used to wake up a sleeping consumer */
+int IdiDoorbellInit(T_IdiDoorbell *pBell)
+{
+    pBell->sleeping.store(0, std::memory_order_relaxed);
+    pBell->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pBell->efd < 0) {
+        err_printf("ERROR: %s- eventfd failed, errno = %d\n", __FUNCTION__, errno);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+
+/* IdiDoorbellRing: called by producers after a push; wakes the consumer only if it sleeps */
+void IdiDoorbellRing(T_IdiDoorbell *pBell)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pBell->sleeping.load(std::memory_order_relaxed) && pBell->sleeping.exchange(0)) {
+        uint64_t one = 1;
+        if (write(pBell->efd, &one, sizeof(one)) != sizeof(one)) {
+            dbg_printf("%s eventfd write failed, errno = %d\n", __FUNCTION__, errno);
+        }
+    }
+}
+
+
+/* IdiDoorbellPrepare: announce the consumer is about to sleep.  The consumer must */
+/* check its rings once more afterwards, then call IdiDoorbellWait or Cancel.      */
+int IdiDoorbellPrepare(T_IdiDoorbell *pBell)
+{
+    pBell->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return SUCCESS;
+}
+
+
+/* IdiDoorbellWait: sleep until a producer rings or timeoutMs elapses (-1 waits forever) */
+int IdiDoorbellWait(T_IdiDoorbell *pBell, int timeoutMs)
+{
+    struct pollfd pfd = {pBell->efd, POLLIN, 0};
+
+    int rc = poll(&pfd, 1, timeoutMs);
+    if (rc > 0) {
+        IdiDoorbellAck(pBell);
+    } else {
+        pBell->sleeping.store(0, std::memory_order_relaxed);
+    }
+
+    return rc;
+}
+
+
+/* IdiDoorbellAck: the consumer is awake again, for consumers that wait on the */
+/* eventfd themselves (epoll) rather than in IdiDoorbellWait                   */
+void IdiDoorbellAck(T_IdiDoorbell *pBell)
+{
+    uint64_t count = 0;
+
+    // drain the counter; a stale wakeup only costs one more empty pass
+    if (read(pBell->efd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        dbg_printf("%s eventfd read failed, errno = %d\n", __FUNCTION__, errno);
+    }
+    pBell->sleeping.store(0, std::memory_order_relaxed);
+}
+
+
+/* IdiDoorbellCancel: the consumer found more work after IdiDoorbellPrepare */
+void IdiDoorbellCancel(T_IdiDoorbell *pBell)
+{
+    pBell->sleeping.store(0, std::memory_order_relaxed);
+}
+
+
+/* IdiPoolInit: preallocate count objects of objSize bytes and fill the free list */
+int IdiPoolInit(T_IdiPool *pPool, uint count, size_t objSize)
+{
+    // keep every object on its own cache line(s) to avoid false sharing between threads
+    objSize = (objSize + IDI_CACHE_LINE - 1) & ~(size_t)(IDI_CACHE_LINE - 1);
+    if (IdiRingInit(&pPool->freeRing, count) != SUCCESS) {
+        return FAILURE;
+    }
+    if (posix_memalign(&pPool->pBlock, IDI_CACHE_LINE, objSize * count) != 0) {
+        err_printf("ERROR: %s- failed to allocate pool of %u objects\n", __FUNCTION__, count);
+        IdiRingFree(&pPool->freeRing);
+        return FAILURE;
+    }
+    memset(pPool->pBlock, 0, objSize * count);
+    pPool->objSize = objSize;
+    pPool->objCount = count;
+    for (uint i = 0; i < count; i++) {
+        IdiRingPush(&pPool->freeRing, (char *)pPool->pBlock + i * objSize);
+    }
+
+    return SUCCESS;
+}
+
+
+/* IdiPoolAlloc: take an object from the pool, NULL when exhausted */
+void *IdiPoolAlloc(T_IdiPool *pPool)
+{
+    void *pObj = NULL;
+
+    if (!IdiRingPop(&pPool->freeRing, &pObj)) {
+        return NULL;
+    }
+    return pObj;
+}
+
+
+/* IdiPoolRelease: return an object to the pool */
+void IdiPoolRelease(T_IdiPool *pPool, void *pObj)
+{
+    if (pObj) {
+        IdiRingPush(&pPool->freeRing, pObj);
+    }
+}
+
+
+/* IdiChunkPoolInit: set up an empty pool; nothing is allocated before the first use */
+void IdiChunkPoolInit(T_IdiChunkPool *pPool, size_t objSize, uint chunkCount, uint maxCount)
+{
+    pPool->objSize = (objSize < sizeof(void *)) ? sizeof(void *) : objSize;
+    pPool->chunkCount = chunkCount ? chunkCount : 1;
+    pPool->maxCount = maxCount;
+    pPool->allocCount = 0;
+    pPool->inUse = 0;
+    pPool->pFree = NULL;
+    pthread_mutex_init(&pPool->lock, NULL);
+}
+
+
+/* IdiChunkPoolAlloc: take a zeroed object, allocating the next chunk when the */
+/* free list is empty.  NULL once maxCount objects are in use.                 */
+void *IdiChunkPoolAlloc(T_IdiChunkPool *pPool)
+{
+    void *pObj = NULL;
+
+    pthread_mutex_lock(&pPool->lock);
+    if (pPool->pFree == NULL && pPool->allocCount < pPool->maxCount) {
+        uint count = pPool->maxCount - pPool->allocCount;
+        if (count > pPool->chunkCount) {
+            count = pPool->chunkCount;
+        }
+        char *pChunk = (char *)malloc(count * pPool->objSize);
+        if (pChunk) {
+            // chunks are kept for the life of the driver, their objects go to the free list
+            for (uint i = count; i-- > 0; ) {
+                *(void **)(pChunk + i * pPool->objSize) = pPool->pFree;
+                pPool->pFree = pChunk + i * pPool->objSize;
+            }
+            pPool->allocCount += count;
+        } else {
+            err_printf("ERROR: %s- failed to allocate a chunk of %u objects\n", __FUNCTION__, count);
+        }
+    }
+    if (pPool->pFree) {
+        pObj = pPool->pFree;
+        pPool->pFree = *(void **)pObj;
+        pPool->inUse++;
+    }
+    pthread_mutex_unlock(&pPool->lock);
+
+    if (pObj) {
+        memset(pObj, 0, pPool->objSize);
+    }
+    return pObj;
+}
+
+
+/* IdiChunkPoolRelease: return an object to the pool */
+void IdiChunkPoolRelease(T_IdiChunkPool *pPool, void *pObj)
+{
+    if (pObj) {
+        pthread_mutex_lock(&pPool->lock);
+        *(void **)pObj = pPool->pFree;
+        pPool->pFree = pObj;
+        pPool->inUse--;
+        pthread_mutex_unlock(&pPool->lock);
+    }
+}
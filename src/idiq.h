@@ -0,0 +1,109 @@
+//
+// idiq.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//
+// In-process bounded lock-free ring, eventfd doorbell and fixed-size object pool
+// used to hand device actions from the Idl callbacks to the action thread, and a
+// pool growing in chunks for objects such as the device storage
+//
+
+#ifndef IDIQ_H
+#define IDIQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <atomic>
+
+#define IDI_CACHE_LINE          64
+
+
+// Bounded ring of opaque handles.  Any number of producers and consumers may
+// use it concurrently; each cell carries a sequence number telling whose turn it is.
+typedef struct _IdiRingCell {
+    std::atomic<size_t> seq;
+    void *pData;
+} T_IdiRingCell;
+
+typedef struct _IdiRing {
+    alignas(IDI_CACHE_LINE) std::atomic<size_t> head;      // next enqueue position
+    alignas(IDI_CACHE_LINE) std::atomic<size_t> tail;      // next dequeue position
+    alignas(IDI_CACHE_LINE) size_t mask;                   // ring size - 1
+    T_IdiRingCell *pCells;
+} T_IdiRing;
+
+// eventfd based wakeup for a consumer that sleeps on one or more rings.  Producers
+// only pay for the write() syscall when the consumer has announced it is going to sleep.
+typedef struct _IdiDoorbell {
+    int efd;
+    std::atomic<int> sleeping;
+} T_IdiDoorbell;
+
+// Fixed-size object pool; the free list is itself a ring of object pointers
+typedef struct _IdiPool {
+    T_IdiRing freeRing;
+    void *pBlock;
+    size_t objSize;
+    uint objCount;
+} T_IdiPool;
+
+// Object pool that allocates chunkCount objects at a time, up to maxCount in all.
+// Freed objects are kept on a free list, linked through their first word.
+typedef struct _IdiChunkPool {
+    size_t objSize;
+    uint chunkCount;
+    uint maxCount;
+    uint allocCount;                        // objects in the chunks allocated so far
+    uint inUse;
+    void *pFree;
+    pthread_mutex_t lock;
+} T_IdiChunkPool;
+
+
+extern int IdiRingInit(T_IdiRing *pRing, uint size);
+extern void IdiRingFree(T_IdiRing *pRing);
+extern bool IdiRingPush(T_IdiRing *pRing, void *pData);
+extern bool IdiRingPop(T_IdiRing *pRing, void **ppData);
+extern bool IdiRingIsEmpty(T_IdiRing *pRing);
+extern size_t IdiRingCount(T_IdiRing *pRing);
+extern bool IdiRingPeek(T_IdiRing *pRing, void **ppData);
+extern size_t IdiRingTicket(T_IdiRing *pRing);
+extern bool IdiRingPassed(T_IdiRing *pRing, size_t ticket);
+
+extern int IdiDoorbellInit(T_IdiDoorbell *pBell);
+extern void IdiDoorbellRing(T_IdiDoorbell *pBell);
+extern int IdiDoorbellPrepare(T_IdiDoorbell *pBell);
+extern int IdiDoorbellWait(T_IdiDoorbell *pBell, int timeoutMs);
+extern void IdiDoorbellCancel(T_IdiDoorbell *pBell);
+extern void IdiDoorbellAck(T_IdiDoorbell *pBell);
+
+extern int IdiPoolInit(T_IdiPool *pPool, uint count, size_t objSize);
+extern void *IdiPoolAlloc(T_IdiPool *pPool);
+extern void IdiPoolRelease(T_IdiPool *pPool, void *pObj);
+
+extern void IdiChunkPoolInit(T_IdiChunkPool *pPool, size_t objSize, uint chunkCount, uint maxCount);
+extern void *IdiChunkPoolAlloc(T_IdiChunkPool *pPool);
+extern void IdiChunkPoolRelease(T_IdiChunkPool *pPool, void *pObj);
+
+#endif
@@ -0,0 +1,153 @@
+//
+// idireactor.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Single event loop serving action shard 0 and the registered descriptors
+//
+
+#include "common.h"
+#include "idireactor.h"
+
+#ifdef IDI_USE_REACTOR
+
+static T_IdiReactor gIdiReactor = {};
+
+
+/* IdiReactorInit: create the epoll instance; the loop runs in IdiReactorRun */
+int IdiReactorInit(void)
+{
+    gIdiReactor.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (gIdiReactor.epfd < 0) {
+        err_printf("ERROR: %s- epoll_create1 failed, errno = %d\n", __FUNCTION__, errno);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+
+/* IdiReactorAdd: have pfnIo called from the loop when fd reports events */
+int IdiReactorAdd(int fd, uint32_t events, T_IdiReactorIoFn pfnIo, void *pCtx)
+{
+    struct epoll_event ev = {};
+
+    if (gIdiReactor.srcCount >= IDI_REACTOR_MAX_SRCS) {
+        err_printf("ERROR: %s- no room for fd %d\n", __FUNCTION__, fd);
+        return FAILURE;
+    }
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(gIdiReactor.epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        err_printf("ERROR: %s- epoll_ctl failed for fd %d, errno = %d\n", __FUNCTION__, fd, errno);
+        return FAILURE;
+    }
+    T_IdiReactorSrc *pSrc = &gIdiReactor.srcs[gIdiReactor.srcCount++];
+    pSrc->fd = fd;
+    pSrc->pfnIo = pfnIo;
+    pSrc->pCtx = pCtx;
+
+    return SUCCESS;
+}
+
+
+/* IdiReactorMod: change the events a registered fd is watched for */
+int IdiReactorMod(int fd, uint32_t events)
+{
+    struct epoll_event ev = {};
+
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(gIdiReactor.epfd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+        dbg_printf("%s epoll_ctl failed for fd %d, errno = %d\n", __FUNCTION__, fd, errno);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+
+/* IdiReactorDel: stop watching fd.  The fd may already be closed. */
+void IdiReactorDel(int fd)
+{
+    epoll_ctl(gIdiReactor.epfd, EPOLL_CTL_DEL, fd, NULL);
+    for (uint i = 0; i < gIdiReactor.srcCount; i++) {
+        if (gIdiReactor.srcs[i].fd == fd) {
+            gIdiReactor.srcs[i] = gIdiReactor.srcs[--gIdiReactor.srcCount];
+            break;
+        }
+    }
+}
+
+
+/* IdiReactorTickSet: have pfnTick called on every pass of the loop */
+void IdiReactorTickSet(T_IdiReactorTickFn pfnTick, void *pCtx)
+{
+    gIdiReactor.pfnTick = pfnTick;
+    gIdiReactor.pTickCtx = pCtx;
+}
+
+
+/* IdiReactorRun: serve action shard 0 and the registered descriptors in the */
+/* calling thread until the executor stops                                   */
+void IdiReactorRun(void)
+{
+    struct epoll_event events[IDI_REACTOR_MAX_EVENTS];
+    struct epoll_event ev = {};
+    int execFd = IdiExecShardFd(0);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = execFd;
+    if (epoll_ctl(gIdiReactor.epfd, EPOLL_CTL_ADD, execFd, &ev) != 0) {
+        err_printf("ERROR: %s- epoll_ctl failed for the action wakeup, errno = %d\n", __FUNCTION__, errno);
+        return;
+    }
+
+    while (IdiExecRunning()) {
+        int tickMs = gIdiReactor.pfnTick ? gIdiReactor.pfnTick(gIdiReactor.pTickCtx) : -1;
+        int timeoutMs = 0;
+        bool bSleep = false;
+
+        if (!IdiExecShardServe(0)) {
+            // nothing to run: block until an action, an fd or the next timer is due
+            timeoutMs = IdiExecShardSleep(0);
+            bSleep = true;
+            if (tickMs >= 0 && (timeoutMs < 0 || tickMs < timeoutMs)) {
+                timeoutMs = tickMs;
+            }
+        }
+        int n = epoll_wait(gIdiReactor.epfd, events, IDI_REACTOR_MAX_EVENTS, timeoutMs);
+        if (bSleep) {
+            IdiExecShardWoken(0);
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            for (uint s = 0; fd != execFd && s < gIdiReactor.srcCount; s++) {
+                if (gIdiReactor.srcs[s].fd == fd) {
+                    gIdiReactor.srcs[s].pfnIo(fd, events[i].events, gIdiReactor.srcs[s].pCtx);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,79 @@
+//
+// idireactor.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Optional single event loop (-DIDI_USE_REACTOR).  One thread waits in epoll on
+// the wakeup of action shard 0 and on any registered descriptor, such as the
+// MQTT client socket, and serves them all, so work that arrives on a socket is
+// run without being handed over to another thread.
+//
+
+#ifndef IDIREACTOR_H
+#define IDIREACTOR_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "idiexec.h"
+
+#ifdef IDI_USE_REACTOR
+
+#ifdef IDI_USE_MQUEUE
+#error "IDI_USE_REACTOR serves the in-process action rings, it can not be combined with IDI_USE_MQUEUE"
+#endif
+
+#define IDI_REACTOR_MAX_SRCS    8       // descriptors besides the action shard wakeup
+#define IDI_REACTOR_MAX_EVENTS  8       // events taken per epoll_wait
+
+
+// Called with the epoll events of a registered descriptor
+typedef void (*T_IdiReactorIoFn)(int fd, uint32_t events, void *pCtx);
+// Called on every pass of the loop; returns how many ms it may sleep at most, -1 for no limit
+typedef int (*T_IdiReactorTickFn)(void *pCtx);
+
+typedef struct _IdiReactorSrc {
+    int fd;
+    T_IdiReactorIoFn pfnIo;
+    void *pCtx;
+} T_IdiReactorSrc;
+
+typedef struct _IdiReactor {
+    int epfd;
+    T_IdiReactorSrc srcs[IDI_REACTOR_MAX_SRCS];
+    uint srcCount;
+    T_IdiReactorTickFn pfnTick;
+    void *pTickCtx;
+} T_IdiReactor;
+
+
+extern int IdiReactorInit(void);
+extern int IdiReactorAdd(int fd, uint32_t events, T_IdiReactorIoFn pfnIo, void *pCtx);
+extern int IdiReactorMod(int fd, uint32_t events);
+extern void IdiReactorDel(int fd);
+extern void IdiReactorTickSet(T_IdiReactorTickFn pfnTick, void *pCtx);
+extern void IdiReactorRun(void);
+
+#endif
+
+#endif
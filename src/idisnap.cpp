@@ -0,0 +1,540 @@
+//
+// idisnap.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Memory mapped register snapshot for warm restarts
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "idisnap.h"
+
+static_assert(sizeof(T_IdiSnapRec) == IDI_CACHE_LINE, "a snapshot record fills one cache line");
+static_assert(sizeof(T_IdiSnapHdr) <= IDI_SNAP_HDR_SIZE, "the snapshot header fits its page");
+
+#define IDI_SNAP_FNV_BASIS      14695981039346656037ull
+#define IDI_SNAP_FNV_PRIME      1099511628211ull
+
+typedef struct {
+    char *pBase;                        // the mapped file
+    size_t size;
+    T_IdiSnapRec *pRecs;                // NULL while there is no snapshot
+    uint32_t mask;                      // record count - 1
+    uint32_t runId;                     // marks the records this run is writing
+    pthread_mutex_t lock;               // serializes attach and detach
+    std::atomic<uint64_t> *pDirty;      // a bit per page written since the last flush
+    size_t pageSize;
+    size_t pageCount;
+    uint flushMs;
+    bool bFullWarned;
+    pthread_t flushThread;
+    bool bFlushThread;                  // flushThread is running
+    bool bStop;                         // set by IdiSnapClose, protected by flushLock
+    pthread_mutex_t flushLock;
+    pthread_cond_t flushCond;           // wakes the flush thread up to stop
+} T_IdiSnap;
+
+static T_IdiSnap gIdiSnap = { NULL, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+
+/* IdiSnapHash: FNV-1a of size bytes, continuing from hash */
+static uint64_t IdiSnapHash(const void *pData, size_t size, uint64_t hash)
+{
+    const uint8_t *pByte = (const uint8_t *)pData;
+
+    while (size--) {
+        hash ^= *pByte++;
+        hash *= IDI_SNAP_FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/* IdiSnapHdrCheck: checksum of a header */
+static uint32_t IdiSnapHdrCheck(const T_IdiSnapHdr *pHdr)
+{
+    uint64_t hash = IdiSnapHash(pHdr, offsetof(T_IdiSnapHdr, check), IDI_SNAP_FNV_BASIS);
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+
+/* IdiSnapRecCheck: checksum of a record's key and value */
+static uint32_t IdiSnapRecCheck(const T_IdiSnapRec *pRec)
+{
+    uint64_t hash = IdiSnapHash(&pRec->key, sizeof(T_IdiSnapRec) - offsetof(T_IdiSnapRec, key), 
+                                IDI_SNAP_FNV_BASIS);
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+
+/* IdiSnapLayoutHash: hash of the names and contents of the XIF files in pXifDir */
+static uint64_t IdiSnapLayoutHash(const char *pXifDir)
+{
+    uint64_t hash = IDI_SNAP_FNV_BASIS;
+    struct dirent **ppNames = NULL;
+    char path[PATH_MAX];
+    char buf[4096];
+
+    // in name order, readdir's order may differ from one boot to the next
+    int count = scandir(pXifDir, &ppNames, NULL, alphasort);
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", pXifDir, ppNames[i]->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            FILE *fp = fopen(path, "r");
+            if (fp) {
+                size_t len;
+                hash = IdiSnapHash(ppNames[i]->d_name, strlen(ppNames[i]->d_name) + 1, hash);
+                while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+                    hash = IdiSnapHash(buf, len, hash);
+                }
+                fclose(fp);
+            }
+        }
+        free(ppNames[i]);
+    }
+    free(ppNames);
+
+    return hash;
+}
+
+
+/* IdiSnapRecLock: take a record for writing.  Returns the lock word found, a run */
+/* id other than 0 means the record was being written when an earlier run died.  */
+static uint32_t IdiSnapRecLock(T_IdiSnapRec *pRec)
+{
+    uint32_t lock = pRec->lock.load(std::memory_order_relaxed);
+
+    for (;;) {
+        if (lock != gIdiSnap.runId && 
+                pRec->lock.compare_exchange_weak(lock, gIdiSnap.runId, std::memory_order_acquire, 
+                                                 std::memory_order_relaxed)) {
+            return lock;
+        }
+        if (lock == gIdiSnap.runId) {
+            sched_yield();
+            lock = pRec->lock.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+/* IdiSnapRecUnlock: let the record go, if it changed sealed with its checksum */
+static void IdiSnapRecUnlock(T_IdiSnapRec *pRec, bool bChanged)
+{
+    if (!bChanged) {
+        pRec->lock.store(0, std::memory_order_release);
+        return;
+    }
+    pRec->check = IdiSnapRecCheck(pRec);
+    pRec->lock.store(0, std::memory_order_release);
+
+    size_t page = ((char *)pRec - gIdiSnap.pBase) / gIdiSnap.pageSize;
+    std::atomic<uint64_t> *pWord = &gIdiSnap.pDirty[page / 64];
+    uint64_t bit = 1ull << (page % 64);
+    if ((pWord->load(std::memory_order_relaxed) & bit) == 0) {
+        pWord->fetch_or(bit, std::memory_order_relaxed);
+    }
+}
+
+
+/* IdiSnapRecPut: keep a value of the given version in a locked record.  A value  */
+/* whose text does not fit is not kept, no value is better than a stale one.       */
+static void IdiSnapRecPut(T_IdiSnapRec *pRec, const T_IdiVal *pVal, uint32_t version)
+{
+    const char *pText = NULL;
+
+    memset(pRec->text, 0, sizeof(pRec->text));
+    pRec->version = version;
+    pRec->type = pVal->type;
+    pRec->len = 0;
+    switch (pVal->type) {
+    case IdiValDouble:
+        pRec->d = pVal->d;
+        break;
+    case IdiValBool:
+        pRec->b = pVal->b;
+        break;
+    case IdiValEnum:
+        pRec->enumIdx = pVal->enumIdx;
+        break;
+    case IdiValString:
+    case IdiValLongString:
+        pText = IdiValStr(pVal);
+        break;
+    case IdiValJson:
+        pText = pVal->pJson;
+        break;
+    default:
+        // no value or null
+        break;
+    }
+    if (pText) {
+        size_t len = strlen(pText);
+        if (len <= IDI_SNAP_TEXT) {
+            memcpy(pRec->text, pText, len);
+            pRec->len = (uint16_t)len;
+        } else {
+            pRec->type = IdiValNone;
+        }
+    }
+}
+
+
+/* IdiSnapRecGet: the value kept in a locked record, false if it has none */
+static bool IdiSnapRecGet(const T_IdiSnapRec *pRec, T_IdiVal *pVal)
+{
+    switch (pRec->type) {
+    case IdiValNull:
+        IdiValSetNull(pVal);
+        break;
+    case IdiValDouble:
+        IdiValSetDouble(pVal, pRec->d);
+        break;
+    case IdiValBool:
+        IdiValClear(pVal);
+        pVal->type = IdiValBool;
+        pVal->b = pRec->b;
+        break;
+    case IdiValEnum:
+        IdiValSetEnum(pVal, pRec->enumIdx);
+        break;
+    case IdiValString:
+    case IdiValLongString:
+        return pRec->len <= IDI_SNAP_TEXT && IdiValSetString(pVal, pRec->text) == SUCCESS;
+    case IdiValJson:
+        return pRec->len <= IDI_SNAP_TEXT && IdiValParse(pVal, pRec->text) == SUCCESS;
+    default:
+        return false;
+    }
+    return true;
+}
+
+
+/* IdiSnapSync: write pageCount pages from page on back to the file */
+static void IdiSnapSync(size_t page, size_t pageCount)
+{
+    if (msync(gIdiSnap.pBase + page * gIdiSnap.pageSize, pageCount * gIdiSnap.pageSize, MS_SYNC) != 0) {
+        err_printf("ERROR: %s- msync of %zu pages failed, errno = %d\n", __FUNCTION__, pageCount, errno);
+    }
+}
+
+
+/* IdiSnapFlush: write the pages changed since the last flush back */
+static void IdiSnapFlush(void)
+{
+    size_t wordCount = (gIdiSnap.pageCount + 63) / 64;
+    size_t runStart = 0;
+    size_t runLen = 0;
+
+    for (size_t w = 0; w < wordCount; w++) {
+        uint64_t bits = gIdiSnap.pDirty[w].load(std::memory_order_relaxed);
+        if (bits) {
+            bits = gIdiSnap.pDirty[w].exchange(0, std::memory_order_acquire);
+        }
+        // adjacent dirty pages go in one msync
+        for (uint b = 0; b < 64; b++) {
+            if (bits & (1ull << b)) {
+                if (runLen++ == 0) {
+                    runStart = w * 64 + b;
+                }
+            } else if (runLen) {
+                IdiSnapSync(runStart, runLen);
+                runLen = 0;
+            }
+        }
+    }
+    if (runLen) {
+        IdiSnapSync(runStart, runLen);
+    }
+}
+
+
+/* IdiSnapFlushThrd: flush every flushMs until IdiSnapClose, then one last time */
+static void *IdiSnapFlushThrd(void *pvArg)
+{
+    struct timespec until;
+
+    pthread_setname_np(pthread_self(), "IdiSnapFlush");
+    pthread_mutex_lock(&gIdiSnap.flushLock);
+    while (!gIdiSnap.bStop) {
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_sec += gIdiSnap.flushMs / 1000;
+        until.tv_nsec += (long)(gIdiSnap.flushMs % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        while (!gIdiSnap.bStop && pthread_cond_timedwait(&gIdiSnap.flushCond, &gIdiSnap.flushLock, 
+                                                         &until) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&gIdiSnap.flushLock);
+        IdiSnapFlush();
+        pthread_mutex_lock(&gIdiSnap.flushLock);
+    }
+    pthread_mutex_unlock(&gIdiSnap.flushLock);
+
+    return NULL;
+}
+
+
+/* IdiSnapOpen: map the snapshot in pDir with room for at least recCount registers. */
+/* A file written for other XIF files in pXifDir, by another version or for another */
+/* size is discarded.  Without a snapshot the registers start out with defaults.    */
+int IdiSnapOpen(const char *pDir, const char *pXifDir, uint recCount, uint flushMs)
+{
+    char path[PATH_MAX];
+    T_IdiSnapHdr hdr;
+    T_IdiSnapHdr fileHdr;
+    struct stat st;
+    uint32_t count = 2;
+    pthread_condattr_t condAttr;
+
+    // at most half full, probe sequences stay short
+    while (count < 2 * (uint64_t)recCount) {
+        count <<= 1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = IDI_SNAP_MAGIC;
+    hdr.version = IDI_SNAP_VERSION;
+    hdr.recSize = sizeof(T_IdiSnapRec);
+    hdr.recCount = count;
+    hdr.layoutHash = IdiSnapLayoutHash(pXifDir);
+    hdr.check = IdiSnapHdrCheck(&hdr);
+    size_t size = IDI_SNAP_HDR_SIZE + (size_t)count * sizeof(T_IdiSnapRec);
+
+    snprintf(path, sizeof(path), "%s/%s-regs.snap", pDir, CDNAME);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+    if (fd < 0) {
+        err_printf("ERROR: %s- unable to open %s, errno = %d, registers start out with defaults\n", 
+                    __FUNCTION__, path, errno);
+        return FAILURE;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size || 
+            pread(fd, &fileHdr, sizeof(fileHdr), 0) != sizeof(fileHdr) || 
+            memcmp(&fileHdr, &hdr, sizeof(hdr)) != 0) {
+        info_printf("INFO: %s- %s does not match the XIF files or the device max count, starting a new one\n", 
+                        __FUNCTION__, path);
+        // the header goes last, a crash in between leaves a file that is discarded again
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0 || 
+                pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+            err_printf("ERROR: %s- unable to set up %s, errno = %d\n", __FUNCTION__, path, errno);
+            close(fd);
+            return FAILURE;
+        }
+    }
+    // only the pages touched are read in, the records are checked when a device attaches
+    void *pBase = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pBase == MAP_FAILED) {
+        err_printf("ERROR: %s- unable to map %s, errno = %d\n", __FUNCTION__, path, errno);
+        return FAILURE;
+    }
+
+    gIdiSnap.pageSize = sysconf(_SC_PAGESIZE);
+    gIdiSnap.pageCount = (size + gIdiSnap.pageSize - 1) / gIdiSnap.pageSize;
+    gIdiSnap.pDirty = (std::atomic<uint64_t> *)calloc((gIdiSnap.pageCount + 63) / 64, sizeof(std::atomic<uint64_t>));
+    if (gIdiSnap.pDirty == NULL) {
+        err_printf("ERROR: %s- out of memory\n", __FUNCTION__);
+        munmap(pBase, size);
+        return FAILURE;
+    }
+    gIdiSnap.pBase = (char *)pBase;
+    gIdiSnap.size = size;
+    gIdiSnap.mask = count - 1;
+    gIdiSnap.runId = ((uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16)) | 1;
+    gIdiSnap.flushMs = flushMs ? flushMs : IDI_SNAP_FLUSH_MS;
+    gIdiSnap.bStop = false;
+    pthread_mutex_init(&gIdiSnap.flushLock, NULL);
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gIdiSnap.flushCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+    if (pthread_create(&gIdiSnap.flushThread, NULL, IdiSnapFlushThrd, NULL) != 0) {
+        err_printf("WARN: %s- no flush thread, the snapshot is written back by the kernel only\n", __FUNCTION__);
+    } else {
+        gIdiSnap.bFlushThread = true;
+    }
+    gIdiSnap.pRecs = (T_IdiSnapRec *)(gIdiSnap.pBase + IDI_SNAP_HDR_SIZE);
+    info_printf("INFO: %s- %s with %u register records, flushed every %u ms\n", __FUNCTION__, path, count, 
+                    gIdiSnap.flushMs);
+
+    return SUCCESS;
+}
+
+
+/* IdiSnapClose: stop the flush thread once it wrote the last changes back.  The     */
+/* snapshot stays mapped, a register changed afterwards is written back by the kernel. */
+void IdiSnapClose(void)
+{
+    if (gIdiSnap.pRecs == NULL) {
+        return;
+    }
+    if (gIdiSnap.bFlushThread) {
+        pthread_mutex_lock(&gIdiSnap.flushLock);
+        gIdiSnap.bStop = true;
+        pthread_cond_signal(&gIdiSnap.flushCond);
+        pthread_mutex_unlock(&gIdiSnap.flushLock);
+        pthread_join(gIdiSnap.flushThread, NULL);
+        gIdiSnap.bFlushThread = false;
+    } else {
+        IdiSnapFlush();
+    }
+    info_printf("INFO: %s- register snapshot written back\n", __FUNCTION__);
+}
+
+
+/* IdiSnapKey: the key a device's records are kept under */
+uint64_t IdiSnapKey(const char *unid)
+{
+    uint64_t key = IdiSnapHash(unid, strlen(unid), IDI_SNAP_FNV_BASIS);
+
+    return key ? key : 1;
+}
+
+
+/* IdiSnapAttach: find or claim the record of a device register.  An empty register  */
+/* gets the value the record kept, a record claimed for a register that has a value  */
+/* (the device got a new unid) keeps that.  IDI_SNAP_NONE when there is no record.  */
+uint32_t IdiSnapAttach(uint64_t key, uint address, T_IdiReg *pReg)
+{
+    uint32_t slot = IDI_SNAP_NONE;
+    uint32_t reuse = IDI_SNAP_NONE;
+    T_IdiVal val = {};
+    T_IdiRegStamp stamp;
+
+    if (gIdiSnap.pRecs == NULL) {
+        return IDI_SNAP_NONE;
+    }
+    pthread_mutex_lock(&gIdiSnap.lock);
+    // state, key and address only change under the lock
+    uint32_t i = (uint32_t)((key ^ (address * 0x9e3779b97f4a7c15ull)) >> 16) & gIdiSnap.mask;
+    for (uint32_t n = 0; n <= gIdiSnap.mask; n++, i = (i + 1) & gIdiSnap.mask) {
+        T_IdiSnapRec *pRec = &gIdiSnap.pRecs[i];
+        if (pRec->state == IdiSnapUsed) {
+            if (pRec->key == key && pRec->address == address) {
+                slot = i;
+                break;
+            }
+        } else {
+            if (reuse == IDI_SNAP_NONE) {
+                reuse = i;
+            }
+            if (pRec->state == IdiSnapFree) {
+                break;
+            }
+        }
+    }
+
+    IdiEbrEnter();
+    if (slot != IDI_SNAP_NONE) {
+        T_IdiSnapRec *pRec = &gIdiSnap.pRecs[slot];
+        uint32_t lock = IdiSnapRecLock(pRec);
+        IdiRegLoadStamped(pReg, &val, &stamp);
+        if (val.type != IdiValNone) {
+            IdiSnapRecPut(pRec, &val, stamp.version);
+        } else if (lock == 0 && pRec->check == IdiSnapRecCheck(pRec) && IdiSnapRecGet(pRec, &val)) {
+            // versions count from the start of a run, the record follows the register's
+            IdiRegStoreIfNone(pReg, &val);
+            IdiRegLoadStamped(pReg, NULL, &stamp);
+            pRec->version = stamp.version;
+        } else {
+            IdiSnapRecPut(pRec, &val, stamp.version);
+        }
+        IdiSnapRecUnlock(pRec, true);
+    } else if (reuse != IDI_SNAP_NONE) {
+        T_IdiSnapRec *pRec = &gIdiSnap.pRecs[reuse];
+        IdiSnapRecLock(pRec);
+        pRec->key = key;
+        pRec->address = address;
+        pRec->state = IdiSnapUsed;
+        IdiRegLoadStamped(pReg, &val, &stamp);
+        IdiSnapRecPut(pRec, &val, stamp.version);
+        IdiSnapRecUnlock(pRec, true);
+        slot = reuse;
+    } else if (!gIdiSnap.bFullWarned) {
+        gIdiSnap.bFullWarned = true;
+        err_printf("WARN: %s- all %u snapshot records are used, further registers are not kept\n", 
+                    __FUNCTION__, gIdiSnap.mask + 1);
+    }
+    IdiEbrExit();
+    pthread_mutex_unlock(&gIdiSnap.lock);
+
+    return slot;
+}
+
+
+/* IdiSnapDetach: give up the record of a register of a deleted device */
+void IdiSnapDetach(uint32_t slot)
+{
+    T_IdiVal val = {};
+
+    if (slot == IDI_SNAP_NONE || gIdiSnap.pRecs == NULL) {
+        return;
+    }
+    T_IdiSnapRec *pRec = &gIdiSnap.pRecs[slot];
+    pthread_mutex_lock(&gIdiSnap.lock);
+    IdiSnapRecLock(pRec);
+    pRec->state = IdiSnapGone;
+    IdiSnapRecPut(pRec, &val, 0);
+    IdiSnapRecUnlock(pRec, true);
+    pthread_mutex_unlock(&gIdiSnap.lock);
+}
+
+
+/* IdiSnapStore: keep the current value of a register in its record.  Called after */
+/* the register changed, from any thread; a record that no longer belongs to key,   */
+/* the device was deleted or got a new unid meanwhile, or that already has this     */
+/* version of the value is left alone.                                              */
+void IdiSnapStore(uint32_t slot, uint64_t key, const T_IdiReg *pReg)
+{
+    T_IdiVal val = {};
+    T_IdiRegStamp stamp;
+    bool bChanged = false;
+
+    if (slot == IDI_SNAP_NONE || gIdiSnap.pRecs == NULL) {
+        return;
+    }
+    T_IdiSnapRec *pRec = &gIdiSnap.pRecs[slot];
+    // the value is loaded under the record's lock, the last writer keeps the newest value
+    IdiEbrEnter();
+    IdiSnapRecLock(pRec);
+    if (pRec->state == IdiSnapUsed && pRec->key == key) {
+        IdiRegLoadStamped(pReg, &val, &stamp);
+        if (stamp.version != pRec->version) {
+            IdiSnapRecPut(pRec, &val, stamp.version);
+            bChanged = true;
+        }
+    }
+    IdiSnapRecUnlock(pRec, bChanged);
+    IdiEbrExit();
+}
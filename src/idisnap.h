@@ -0,0 +1,96 @@
+//
+// idisnap.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Register snapshot for warm restarts.  The last known value of every register is
+// kept in a memory mapped file, $APOLLO_DATA/<cdname>/<cdname>-regs.snap, so a
+// restarted driver answers reads of a device it knew with the values its registers
+// had instead of the XIF defaults.  The file is an open addressing table of one cache
+// line records keyed by the device's unid hash and the register address.  Each
+// record carries a checksum and the run id of the writer holding it, a record torn
+// by a crash is dropped.  The header carries a version and a hash of the XIF files,
+// the whole file is discarded when either changed.  Values whose text does not fit
+// in a record are not kept.  A record is only rewritten for a newer version of its
+// register's value, a flush thread writes the pages changed back.  The snapshot
+// is off unless enabled in the conf.
+//
+
+#ifndef IDISNAP_H
+#define IDISNAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+
+#include "idival.h"
+
+#define IDI_SNAP_VERSION        2
+#define IDI_SNAP_MAGIC          0x50414e53u     // "SNAP"
+#define IDI_SNAP_HDR_SIZE       4096            // header page, the records follow it
+#define IDI_SNAP_TEXT           31              // longest string or JSON text kept
+#define IDI_SNAP_NONE           UINT32_MAX      // register not kept in the snapshot
+#define IDI_SNAP_REGS_PER_DEV   16              // default records per device once the snapshot is enabled
+#define IDI_SNAP_FLUSH_MS       5000            // default time between flushes of the dirty pages
+
+typedef enum {
+    IdiSnapFree = 0,                    // never used, ends a probe sequence
+    IdiSnapUsed,
+    IdiSnapGone                         // used before, may be claimed again
+} IdiSnapState;
+
+typedef struct _IdiSnapHdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recSize;
+    uint32_t recCount;                  // a power of 2
+    uint64_t layoutHash;                // hash of the XIF files the registers were laid out by
+    uint32_t check;                     // checksum of the fields above
+} T_IdiSnapHdr;
+
+typedef struct _IdiSnapRec {
+    std::atomic<uint32_t> lock;         // run id of its writer, 0 while not written
+    uint32_t check;                     // checksum of the fields below
+    uint64_t key;                       // IdiSnapKey of the device's unid
+    uint32_t address;                   // register address
+    uint32_t version;                   // version of the register value kept (T_IdiRegStamp)
+    uint8_t state;                      // IdiSnapState
+    uint8_t type;                       // IdiValType of the value kept, IdiValNone if none
+    uint16_t len;                       // text length
+    union {
+        double d;
+        bool b;
+        int32_t enumIdx;
+        char text[IDI_SNAP_TEXT + 1];
+    };
+} T_IdiSnapRec;
+
+
+extern int IdiSnapOpen(const char *pDir, const char *pXifDir, uint recCount, uint flushMs);
+extern void IdiSnapClose(void);
+extern uint64_t IdiSnapKey(const char *unid);
+extern uint32_t IdiSnapAttach(uint64_t key, uint address, T_IdiReg *pReg);
+extern void IdiSnapDetach(uint32_t slot);
+extern void IdiSnapStore(uint32_t slot, uint64_t key, const T_IdiReg *pReg);
+
+#endif
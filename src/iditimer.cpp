@@ -0,0 +1,227 @@
+//
+// iditimer.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Hierarchical timing wheel
+//
+// A timer sits on the lowest level whose slot index is the only part of its
+// expiry time that differs from the wheel's current time.  When the current time
+// reaches the start of a higher level slot, the slot is cascaded: its timers are
+// placed again, now on a lower level.  The occupancy bits let the wheel skip
+// straight to the next tick that has something to do.
+//
+
+#include "common.h"
+#include "iditimer.h"
+
+#define IDI_WHEEL_MASK          (IDI_WHEEL_SLOTS - 1)
+#define IDI_WHEEL_SPAN_BITS     (IDI_WHEEL_BITS * IDI_WHEEL_LEVELS)
+#define IDI_WHEEL_DETACHED      0xff        // level of a timer taken off the wheel to fire
+
+
+static void IdiTimerListInit(T_IdiTimer *pHead)
+{
+    pHead->pNext = pHead->pPrev = pHead;
+}
+
+
+static void IdiTimerListAppend(T_IdiTimer *pHead, T_IdiTimer *pTimer)
+{
+    pTimer->pPrev = pHead->pPrev;
+    pTimer->pNext = pHead;
+    pHead->pPrev->pNext = pTimer;
+    pHead->pPrev = pTimer;
+}
+
+
+/* IdiTimerListTake: move the whole list to pTo, leaving pHead empty */
+static void IdiTimerListTake(T_IdiTimer *pHead, T_IdiTimer *pTo)
+{
+    IdiTimerListInit(pTo);
+    if (pHead->pNext != pHead) {
+        pTo->pNext = pHead->pNext;
+        pTo->pPrev = pHead->pPrev;
+        pTo->pNext->pPrev = pTo;
+        pTo->pPrev->pNext = pTo;
+        IdiTimerListInit(pHead);
+    }
+}
+
+
+/* IdiWheelPlace: put a timer on the wheel; expireMs must not be in the past */
+static void IdiWheelPlace(T_IdiWheel *pWheel, T_IdiTimer *pTimer)
+{
+    uint64_t diff = pTimer->expireMs ^ pWheel->nowMs;
+
+    for (uint level = 0; level < IDI_WHEEL_LEVELS; level++) {
+        if ((diff >> (IDI_WHEEL_BITS * (level + 1))) == 0) {
+            uint slot = (pTimer->expireMs >> (IDI_WHEEL_BITS * level)) & IDI_WHEEL_MASK;
+            pTimer->level = level;
+            pTimer->slot = slot;
+            IdiTimerListAppend(&pWheel->slots[level][slot], pTimer);
+            pWheel->occupied[level] |= (uint64_t)1 << slot;
+            return;
+        }
+    }
+    pTimer->level = IDI_WHEEL_LEVELS;
+    pTimer->slot = 0;
+    IdiTimerListAppend(&pWheel->overflow, pTimer);
+}
+
+
+/* IdiWheelCascade: place the timers of a slot again relative to the current time */
+static void IdiWheelCascade(T_IdiWheel *pWheel, T_IdiTimer *pHead)
+{
+    T_IdiTimer list;
+
+    IdiTimerListTake(pHead, &list);
+    while (list.pNext != &list) {
+        T_IdiTimer *pTimer = list.pNext;
+        pTimer->pNext->pPrev = &list;
+        list.pNext = pTimer->pNext;
+        IdiWheelPlace(pWheel, pTimer);
+    }
+}
+
+
+/* IdiWheelInit: set up an empty wheel starting at nowMs */
+void IdiWheelInit(T_IdiWheel *pWheel, uint64_t nowMs)
+{
+    pWheel->nowMs = nowMs;
+    pWheel->count = 0;
+    for (uint level = 0; level < IDI_WHEEL_LEVELS; level++) {
+        pWheel->occupied[level] = 0;
+        for (uint slot = 0; slot < IDI_WHEEL_SLOTS; slot++) {
+            IdiTimerListInit(&pWheel->slots[level][slot]);
+        }
+    }
+    IdiTimerListInit(&pWheel->overflow);
+}
+
+
+/* IdiTimerAdd: arm a timer to fire at expireMs; an expiry in the past fires on */
+/* the next tick.  An armed timer is moved.                                      */
+void IdiTimerAdd(T_IdiWheel *pWheel, T_IdiTimer *pTimer, uint64_t expireMs)
+{
+    IdiTimerCancel(pWheel, pTimer);
+    pTimer->expireMs = (expireMs > pWheel->nowMs) ? expireMs : pWheel->nowMs + 1;
+    IdiWheelPlace(pWheel, pTimer);
+    pWheel->count++;
+}
+
+
+/* IdiTimerCancel: disarm a timer; does nothing if it is not armed */
+void IdiTimerCancel(T_IdiWheel *pWheel, T_IdiTimer *pTimer)
+{
+    if (pTimer->pNext == NULL) {
+        return;
+    }
+    pTimer->pPrev->pNext = pTimer->pNext;
+    pTimer->pNext->pPrev = pTimer->pPrev;
+    if (pTimer->level < IDI_WHEEL_LEVELS && pTimer->pPrev == pTimer->pNext) {
+        // only the list head is left
+        pWheel->occupied[pTimer->level] &= ~((uint64_t)1 << pTimer->slot);
+    }
+    pTimer->pNext = pTimer->pPrev = NULL;
+    pWheel->count--;
+}
+
+
+/* IdiTimerIsArmed: true while the timer is on the wheel */
+bool IdiTimerIsArmed(const T_IdiTimer *pTimer)
+{
+    return pTimer->pNext != NULL;
+}
+
+
+/* IdiWheelNextMs: earliest time the wheel has work to do, IDI_WHEEL_NEVER when */
+/* it is empty.  This is the exact expiry for the first level and the time of   */
+/* the next cascade otherwise.                                                  */
+uint64_t IdiWheelNextMs(T_IdiWheel *pWheel)
+{
+    uint64_t next = IDI_WHEEL_NEVER;
+
+    if (pWheel->count == 0) {
+        return next;
+    }
+    for (uint level = 0; level < IDI_WHEEL_LEVELS; level++) {
+        uint shift = IDI_WHEEL_BITS * level;
+        uint cur = (pWheel->nowMs >> shift) & IDI_WHEEL_MASK;
+        // every timer on a level lies after the current slot of that level
+        uint64_t ahead = (cur == IDI_WHEEL_MASK) ? 0 : pWheel->occupied[level] & (~(uint64_t)0 << (cur + 1));
+        if (ahead) {
+            uint64_t base = (pWheel->nowMs >> (shift + IDI_WHEEL_BITS)) << (shift + IDI_WHEEL_BITS);
+            uint64_t at = base + ((uint64_t)__builtin_ctzll(ahead) << shift);
+            if (at < next) {
+                next = at;
+            }
+        }
+    }
+    if (pWheel->overflow.pNext != &pWheel->overflow) {
+        uint64_t at = ((pWheel->nowMs >> IDI_WHEEL_SPAN_BITS) + 1) << IDI_WHEEL_SPAN_BITS;
+        if (at < next) {
+            next = at;
+        }
+    }
+    return next;
+}
+
+
+/* IdiWheelAdvance: move the wheel up to nowMs, calling pfnFire for every timer */
+/* that expired.  pfnFire may add and cancel timers, including the one firing.   */
+void IdiWheelAdvance(T_IdiWheel *pWheel, uint64_t nowMs, T_IdiTimerFn pfnFire, void *pCtx)
+{
+    T_IdiTimer due;
+
+    while (pWheel->nowMs < nowMs) {
+        uint64_t next = IdiWheelNextMs(pWheel);
+        if (next > nowMs) {
+            pWheel->nowMs = nowMs;
+            break;
+        }
+        uint64_t tick = next;
+        pWheel->nowMs = tick;
+
+        if ((tick & (((uint64_t)1 << IDI_WHEEL_SPAN_BITS) - 1)) == 0) {
+            IdiWheelCascade(pWheel, &pWheel->overflow);
+        }
+        for (int level = IDI_WHEEL_LEVELS - 1; level > 0; level--) {
+            uint shift = IDI_WHEEL_BITS * level;
+            if ((tick & (((uint64_t)1 << shift) - 1)) == 0) {
+                uint slot = (tick >> shift) & IDI_WHEEL_MASK;
+                pWheel->occupied[level] &= ~((uint64_t)1 << slot);
+                IdiWheelCascade(pWheel, &pWheel->slots[level][slot]);
+            }
+        }
+
+        uint slot = tick & IDI_WHEEL_MASK;
+        pWheel->occupied[0] &= ~((uint64_t)1 << slot);
+        IdiTimerListTake(&pWheel->slots[0][slot], &due);
+        for (T_IdiTimer *pTimer = due.pNext; pTimer != &due; pTimer = due.pNext) {
+            pTimer->level = IDI_WHEEL_DETACHED;
+            IdiTimerCancel(pWheel, pTimer);
+            pfnFire(pTimer, pCtx);
+        }
+    }
+}
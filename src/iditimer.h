@@ -0,0 +1,70 @@
+//
+// iditimer.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Hierarchical timing wheel with millisecond ticks on the monotonic clock.  Timers
+// are intrusive nodes; adding and cancelling one is O(1).  A wheel is not locked,
+// only the thread owning it may use it.
+//
+
+#ifndef IDITIMER_H
+#define IDITIMER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IDI_WHEEL_BITS          6
+#define IDI_WHEEL_SLOTS         (1 << IDI_WHEEL_BITS)          // slots per level
+#define IDI_WHEEL_LEVELS        4                              // covers 2^24 ms (~4.6 hours)
+#define IDI_WHEEL_NEVER         UINT64_MAX
+
+
+typedef struct _IdiTimer {
+    struct _IdiTimer *pNext;        // NULL while the timer is not armed
+    struct _IdiTimer *pPrev;
+    uint64_t expireMs;
+    void *pOwner;                   // object the timer belongs to
+    uint8_t level;                  // wheel position, used to keep the occupancy bits exact
+    uint8_t slot;
+} T_IdiTimer;
+
+typedef void (*T_IdiTimerFn)(T_IdiTimer *pTimer, void *pCtx);
+
+typedef struct _IdiWheel {
+    uint64_t nowMs;                                     // last tick processed
+    uint count;                                         // armed timers
+    uint64_t occupied[IDI_WHEEL_LEVELS];                // non-empty slots per level
+    T_IdiTimer slots[IDI_WHEEL_LEVELS][IDI_WHEEL_SLOTS];    // list heads
+    T_IdiTimer overflow;                                // timers beyond the last level
+} T_IdiWheel;
+
+
+extern void IdiWheelInit(T_IdiWheel *pWheel, uint64_t nowMs);
+extern void IdiTimerAdd(T_IdiWheel *pWheel, T_IdiTimer *pTimer, uint64_t expireMs);
+extern void IdiTimerCancel(T_IdiWheel *pWheel, T_IdiTimer *pTimer);
+extern bool IdiTimerIsArmed(const T_IdiTimer *pTimer);
+extern uint64_t IdiWheelNextMs(T_IdiWheel *pWheel);
+extern void IdiWheelAdvance(T_IdiWheel *pWheel, uint64_t nowMs, T_IdiTimerFn pfnFire, void *pCtx);
+
+#endif
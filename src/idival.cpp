@@ -0,0 +1,612 @@
+//
+// idival.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Tagged register values and the registers holding them
+//
+
+#include <ctype.h>
+#include <math.h>
+#include <limits.h>
+
+#include "common.h"
+#include "idiexec.h"
+
+#define IDI_VAL_NUM_CHARS       "+-.0123456789eE"
+#define IDI_VAL_WORDS           (sizeof(T_IdiVal) / sizeof(uint64_t))
+
+static_assert(sizeof(T_IdiVal) % sizeof(uint64_t) == 0, "T_IdiVal is copied a word at a time");
+
+
+/* IdiValClear: drop the value, freeing what it keeps out of line */
+void IdiValClear(T_IdiVal *pVal)
+{
+    if (pVal->type == IdiValLongString) {
+        free(pVal->pStr);
+    } else if (pVal->type == IdiValJson) {
+        free(pVal->pJson);
+    }
+    pVal->type = IdiValNone;
+}
+
+
+/* IdiValSetDouble: set a number */
+void IdiValSetDouble(T_IdiVal *pVal, double d)
+{
+    IdiValClear(pVal);
+    pVal->type = IdiValDouble;
+    pVal->d = d;
+}
+
+
+/* IdiValSetEnum: set an index into the datapoint's enum map */
+void IdiValSetEnum(T_IdiVal *pVal, int enumIdx)
+{
+    IdiValClear(pVal);
+    pVal->type = IdiValEnum;
+    pVal->enumIdx = enumIdx;
+}
+
+
+/* IdiValSetNull: set JSON null */
+void IdiValSetNull(T_IdiVal *pVal)
+{
+    IdiValClear(pVal);
+    pVal->type = IdiValNull;
+}
+
+
+/* IdiValSetStringN: set a string of len chars, inline when it is short enough */
+static int IdiValSetStringN(T_IdiVal *pVal, const char *pStr, size_t len)
+{
+    IdiValClear(pVal);
+    if (len <= IDI_VAL_INLINE_STR) {
+        memcpy(pVal->str, pStr, len);
+        pVal->str[len] = '\0';
+        pVal->type = IdiValString;
+    } else {
+        pVal->pStr = strndup(pStr, len);
+        if (pVal->pStr == NULL) {
+            return FAILURE;
+        }
+        pVal->type = IdiValLongString;
+    }
+    return SUCCESS;
+}
+
+
+/* IdiValSetString: set a string */
+int IdiValSetString(T_IdiVal *pVal, const char *pStr)
+{
+    return IdiValSetStringN(pVal, pStr ? pStr : "", pStr ? strlen(pStr) : 0);
+}
+
+
+/* IdiValSetJson: set the value of a cJSON item; objects and arrays are kept as text */
+int IdiValSetJson(T_IdiVal *pVal, const cJSON *pJson)
+{
+    int rc = SUCCESS;
+
+    if (cJSON_IsString(pJson)) {
+        rc = IdiValSetString(pVal, pJson->valuestring);
+    } else if (cJSON_IsNumber(pJson)) {
+        IdiValSetDouble(pVal, pJson->valuedouble);
+    } else if (cJSON_IsBool(pJson)) {
+        IdiValClear(pVal);
+        pVal->type = IdiValBool;
+        pVal->b = cJSON_IsTrue(pJson);
+    } else if (cJSON_IsNull(pJson)) {
+        IdiValSetNull(pVal);
+    } else if (cJSON_IsObject(pJson) || cJSON_IsArray(pJson)) {
+        IdiValClear(pVal);
+        pVal->pJson = cJSON_PrintUnformatted(pJson);
+        if (pVal->pJson) {
+            pVal->type = IdiValJson;
+        } else {
+            rc = FAILURE;
+        }
+    } else {
+        IdiValClear(pVal);
+        rc = FAILURE;
+    }
+    return rc;
+}
+
+
+/* IdiValSetJsonText: set an object or array given as len chars of JSON text, */
+/* e.g. printed by a codec; the text is taken as it is                        */
+int IdiValSetJsonText(T_IdiVal *pVal, const char *pText, size_t len)
+{
+    IdiValClear(pVal);
+    pVal->pJson = strndup(pText, len);
+    if (pVal->pJson == NULL) {
+        return FAILURE;
+    }
+    pVal->type = IdiValJson;
+    return SUCCESS;
+}
+
+
+/* IdiValParse: set the value given as JSON text, e.g. an ETI register message.     */
+/* Numbers, true, false, null and strings without escapes are taken without cJSON. */
+int IdiValParse(T_IdiVal *pVal, const char *pText)
+{
+    const char *pEnd;
+    size_t len;
+
+    while (isspace((unsigned char)*pText)) {
+        pText++;
+    }
+    len = strlen(pText);
+    while (len && isspace((unsigned char)pText[len - 1])) {
+        len--;
+    }
+
+    if (len && strspn(pText, IDI_VAL_NUM_CHARS) == len) {
+        char *pNumEnd;
+        double d = strtod(pText, &pNumEnd);
+        if (pNumEnd == pText + len) {
+            IdiValSetDouble(pVal, d);
+            return SUCCESS;
+        }
+    } else if (len == 4 && strncmp(pText, "true", 4) == 0) {
+        IdiValClear(pVal);
+        pVal->type = IdiValBool;
+        pVal->b = true;
+        return SUCCESS;
+    } else if (len == 5 && strncmp(pText, "false", 5) == 0) {
+        IdiValClear(pVal);
+        pVal->type = IdiValBool;
+        pVal->b = false;
+        return SUCCESS;
+    } else if (len == 4 && strncmp(pText, "null", 4) == 0) {
+        IdiValSetNull(pVal);
+        return SUCCESS;
+    } else if (len >= 2 && pText[0] == '"' && pText[len - 1] == '"') {
+        pEnd = pText + 1;
+        while (pEnd < pText + len - 1 && *pEnd != '"' && *pEnd != '\\' && (unsigned char)*pEnd >= 0x20) {
+            pEnd++;
+        }
+        if (pEnd == pText + len - 1) {
+            return IdiValSetStringN(pVal, pText + 1, len - 2);
+        }
+    }
+
+    // anything else, escapes, objects and arrays go through cJSON
+    cJSON *pJson = IdlStringTocJSON((char *)pText);
+    if (pJson == NULL) {
+        IdiValClear(pVal);
+        return FAILURE;
+    }
+    int rc = IdiValSetJson(pVal, pJson);
+    IdlCjsonDelete(pJson);
+
+    return rc;
+}
+
+
+/* IdiValMove: hand the value of pSrc, including what it keeps out of line, to pDst */
+void IdiValMove(T_IdiVal *pDst, T_IdiVal *pSrc)
+{
+    if (pDst != pSrc) {
+        IdiValClear(pDst);
+        memcpy(pDst, pSrc, sizeof(T_IdiVal));
+        pSrc->type = IdiValNone;
+    }
+}
+
+
+/* IdiValEqual: true if both hold the same value */
+bool IdiValEqual(const T_IdiVal *pVal1, const T_IdiVal *pVal2)
+{
+    if (pVal1->type != pVal2->type) {
+        return false;
+    }
+    switch (pVal1->type) {
+    case IdiValDouble:
+        return pVal1->d == pVal2->d;
+    case IdiValBool:
+        return pVal1->b == pVal2->b;
+    case IdiValEnum:
+        return pVal1->enumIdx == pVal2->enumIdx;
+    case IdiValString:
+        return strcmp(pVal1->str, pVal2->str) == 0;
+    case IdiValLongString:
+        return strcmp(pVal1->pStr, pVal2->pStr) == 0;
+    case IdiValJson:
+        return strcmp(pVal1->pJson, pVal2->pJson) == 0;
+    default:
+        return true;
+    }
+}
+
+
+/* IdiValStr: the string of a string value, NULL for any other value */
+const char *IdiValStr(const T_IdiVal *pVal)
+{
+    if (pVal->type == IdiValString) {
+        return pVal->str;
+    }
+    if (pVal->type == IdiValLongString) {
+        return pVal->pStr;
+    }
+    return NULL;
+}
+
+
+// the thread's serialization buffer, freed when the thread exits
+static thread_local struct _IdiBufLocal {
+    T_IdiBuf buf;
+    ~_IdiBufLocal() { free(buf.pData); }
+} tIdiBuf;
+
+
+/* IdiBufLocal: the calling thread's buffer, emptied.  What was written to it before */
+/* is overwritten by the next serialization on the same thread.                      */
+T_IdiBuf *IdiBufLocal(void)
+{
+    tIdiBuf.buf.len = 0;
+    return &tIdiBuf.buf;
+}
+
+
+/* IdiBufReserve: make room for len more characters and the terminating '\0' */
+static bool IdiBufReserve(T_IdiBuf *pBuf, size_t len)
+{
+    size_t need = pBuf->len + len + 1;
+
+    if (need > pBuf->size) {
+        size_t size = pBuf->size ? pBuf->size : IDI_BUF_MIN_SIZE;
+        while (size < need) {
+            size <<= 1;
+        }
+        char *pData = (char *)realloc(pBuf->pData, size);
+        if (pData == NULL) {
+            err_printf("ERROR: %s- failed to grow buffer to %zu bytes\n", __FUNCTION__, size);
+            return false;
+        }
+        pBuf->pData = pData;
+        pBuf->size = size;
+    }
+    return true;
+}
+
+
+/* IdiBufPut: append a string */
+bool IdiBufPut(T_IdiBuf *pBuf, const char *pStr)
+{
+    size_t len = strlen(pStr);
+
+    if (!IdiBufReserve(pBuf, len)) {
+        return false;
+    }
+    memcpy(pBuf->pData + pBuf->len, pStr, len + 1);
+    pBuf->len += len;
+    return true;
+}
+
+
+/* IdiBufPutNumber: append a number the way cJSON prints it */
+bool IdiBufPutNumber(T_IdiBuf *pBuf, double d)
+{
+    int i = (d >= INT_MAX) ? INT_MAX : (d <= (double)INT_MIN) ? INT_MIN : (int)d;
+    double check;
+
+    if (!IdiBufReserve(pBuf, IDI_BUF_NUM_SIZE)) {
+        return false;
+    }
+    char *pOut = pBuf->pData + pBuf->len;
+    int len;
+    if (isnan(d) || isinf(d)) {
+        len = snprintf(pOut, IDI_BUF_NUM_SIZE, "null");
+    } else if (d == (double)i) {
+        len = snprintf(pOut, IDI_BUF_NUM_SIZE, "%d", i);
+    } else {
+        len = snprintf(pOut, IDI_BUF_NUM_SIZE, "%1.15g", d);
+        if (sscanf(pOut, "%lg", &check) != 1 || check != d) {
+            len = snprintf(pOut, IDI_BUF_NUM_SIZE, "%1.17g", d);
+        }
+    }
+    pBuf->len += len;
+    return true;
+}
+
+
+/* IdiValStringText: append a string quoted and escaped as JSON text */
+static bool IdiValStringText(const char *pStr, T_IdiBuf *pBuf)
+{
+    size_t len = 2;
+    const unsigned char *p;
+
+    for (p = (const unsigned char *)pStr; *p; p++) {
+        len += (*p == '"' || *p == '\\' || *p == '\b' || *p == '\f' || *p == '\n' || *p == '\r' || *p == '\t') ? 2 : 
+               (*p < 0x20) ? 6 : 1;
+    }
+    if (!IdiBufReserve(pBuf, len)) {
+        return false;
+    }
+
+    char *pOut = pBuf->pData + pBuf->len;
+    *pOut++ = '"';
+    for (p = (const unsigned char *)pStr; *p; p++) {
+        switch (*p) {
+        case '"':  *pOut++ = '\\'; *pOut++ = '"'; break;
+        case '\\': *pOut++ = '\\'; *pOut++ = '\\'; break;
+        case '\b': *pOut++ = '\\'; *pOut++ = 'b'; break;
+        case '\f': *pOut++ = '\\'; *pOut++ = 'f'; break;
+        case '\n': *pOut++ = '\\'; *pOut++ = 'n'; break;
+        case '\r': *pOut++ = '\\'; *pOut++ = 'r'; break;
+        case '\t': *pOut++ = '\\'; *pOut++ = 't'; break;
+        default:
+            if (*p < 0x20) {
+                pOut += sprintf(pOut, "\\u%04x", *p);
+            } else {
+                *pOut++ = *p;
+            }
+            break;
+        }
+    }
+    *pOut++ = '"';
+    *pOut = '\0';
+    pBuf->len += len;
+
+    return true;
+}
+
+
+/* IdiValWrite: append the value as JSON text to pBuf, as cJSON_PrintUnformatted would */
+/* print it.  pEnumStr is the enum string of an enum value, NULL prints null.  Returns */
+/* the buffer's text, NULL if there is no value or the buffer could not grow.           */
+const char *IdiValWrite(const T_IdiVal *pVal, const char *pEnumStr, T_IdiBuf *pBuf)
+{
+    bool bOk;
+
+    switch (pVal->type) {
+    case IdiValNull:
+        bOk = IdiBufPut(pBuf, "null");
+        break;
+    case IdiValDouble:
+        bOk = IdiBufPutNumber(pBuf, pVal->d);
+        break;
+    case IdiValBool:
+        bOk = IdiBufPut(pBuf, pVal->b ? "true" : "false");
+        break;
+    case IdiValEnum:
+        bOk = pEnumStr ? IdiValStringText(pEnumStr, pBuf) : IdiBufPut(pBuf, "null");
+        break;
+    case IdiValString:
+    case IdiValLongString:
+        bOk = IdiValStringText(IdiValStr(pVal), pBuf);
+        break;
+    case IdiValJson:
+        bOk = IdiBufPut(pBuf, pVal->pJson);
+        break;
+    default:
+        bOk = false;
+        break;
+    }
+
+    return bOk ? pBuf->pData : NULL;
+}
+
+
+/* IdiRegLoadStamped: copy the register's value and its stamp, either may be NULL. */
+/* Out of line parts of the value are shared with the register, the caller has to  */
+/* be in an IdiEbrEnter section while it uses them and must not clear the copy.     */
+void IdiRegLoadStamped(const T_IdiReg *pReg, T_IdiVal *pVal, T_IdiRegStamp *pStamp)
+{
+    const uint64_t *pSrc = (const uint64_t *)&pReg->val;
+    uint64_t *pDst = (uint64_t *)pVal;
+    uint32_t seq1, seq2;
+
+    do {
+        seq1 = pReg->seq.load(std::memory_order_acquire);
+        while (seq1 & 1) {
+            sched_yield();
+            seq1 = pReg->seq.load(std::memory_order_acquire);
+        }
+        for (uint i = 0; pVal && i < IDI_VAL_WORDS; i++) {
+            pDst[i] = __atomic_load_n(&pSrc[i], __ATOMIC_RELAXED);
+        }
+        if (pStamp) {
+            pStamp->version = __atomic_load_n(&pReg->stamp.version, __ATOMIC_RELAXED);
+            pStamp->changedMs = __atomic_load_n(&pReg->stamp.changedMs, __ATOMIC_RELAXED);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq2 = pReg->seq.load(std::memory_order_relaxed);
+    } while (seq1 != seq2);
+}
+
+
+/* IdiRegLoad: copy the register's value, see IdiRegLoadStamped */
+void IdiRegLoad(const T_IdiReg *pReg, T_IdiVal *pVal)
+{
+    IdiRegLoadStamped(pReg, pVal, NULL);
+}
+
+
+/* IdiRegChangedSince: true if the value changed after the given version was loaded */
+bool IdiRegChangedSince(const T_IdiReg *pReg, uint32_t version)
+{
+    // a single word, the seqlock is not needed for it
+    return __atomic_load_n(&pReg->stamp.version, __ATOMIC_ACQUIRE) != version;
+}
+
+
+/* IdiRegHasValue: true once the register holds a value */
+bool IdiRegHasValue(const T_IdiReg *pReg)
+{
+    T_IdiVal val;
+
+    IdiRegLoad(pReg, &val);
+    return val.type != IdiValNone;
+}
+
+
+/* IdiRegLock: become the register's only writer */
+static uint32_t IdiRegLock(T_IdiReg *pReg)
+{
+    uint32_t seq = pReg->seq.load(std::memory_order_relaxed);
+
+    for (;;) {
+        if ((seq & 1) == 0 && 
+                pReg->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            break;
+        }
+        if (seq & 1) {
+            sched_yield();
+            seq = pReg->seq.load(std::memory_order_relaxed);
+        }
+    }
+    // readers seeing any of the following stores see the odd sequence as well
+    std::atomic_thread_fence(std::memory_order_release);
+    return seq;
+}
+
+
+/* IdiRegPut: replace the value of a locked register, count the change and unlock */
+/* it; changedMs stamps it, 0 keeps the stamp.  The old value's out of line       */
+/* storage is retired.                                                            */
+static void IdiRegPut(T_IdiReg *pReg, uint32_t seq, T_IdiVal *pVal, uint64_t changedMs)
+{
+    T_IdiVal old = pReg->val;
+    uint64_t *pDst = (uint64_t *)&pReg->val;
+    const uint64_t *pSrc = (const uint64_t *)pVal;
+
+    for (uint i = 0; i < IDI_VAL_WORDS; i++) {
+        __atomic_store_n(&pDst[i], pSrc[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&pReg->stamp.version, pReg->stamp.version + 1, __ATOMIC_RELAXED);
+    if (changedMs) {
+        __atomic_store_n(&pReg->stamp.changedMs, changedMs, __ATOMIC_RELAXED);
+    }
+    pReg->seq.store(seq + 2, std::memory_order_release);
+    pVal->type = IdiValNone;
+
+    if (old.type == IdiValLongString) {
+        IdiEbrRetire(old.pStr, free);
+    } else if (old.type == IdiValJson) {
+        IdiEbrRetire(old.pJson, free);
+    }
+}
+
+
+/* IdiRegStore: move *pVal into the register; true if that changed its value, */
+/* which counts and stamps the change.  *pVal is left without value either way. */
+bool IdiRegStore(T_IdiReg *pReg, T_IdiVal *pVal)
+{
+    uint32_t seq = IdiRegLock(pReg);
+
+    if (IdiValEqual(&pReg->val, pVal)) {
+        pReg->seq.store(seq + 2, std::memory_order_release);
+        IdiValClear(pVal);
+        return false;
+    }
+    IdiRegPut(pReg, seq, pVal, IdiNowMs());
+    return true;
+}
+
+
+/* IdiRegStoreIfNone: move *pVal into the register unless it already has a value, */
+/* e.g. a datapoint default that must not replace what the device reported.  The  */
+/* change is counted, not stamped: the device did not report the value.           */
+bool IdiRegStoreIfNone(T_IdiReg *pReg, T_IdiVal *pVal)
+{
+    uint32_t seq = IdiRegLock(pReg);
+
+    if (pReg->val.type != IdiValNone) {
+        pReg->seq.store(seq + 2, std::memory_order_release);
+        IdiValClear(pVal);
+        return false;
+    }
+    IdiRegPut(pReg, seq, pVal, 0);
+    return true;
+}
+
+
+/* IdiRegClear: drop the register's value */
+void IdiRegClear(T_IdiReg *pReg)
+{
+    T_IdiVal none = {};
+
+    IdiRegStore(pReg, &none);
+}
+
+
+/* IdiRegText: the JSON text of the register's value, enum values as their string in  */
+/* ppEnumStrs.  It is printed only if the value changed since it was last printed or  */
+/* was printed with other enum strings.  The caller has to be in an IdiEbrEnter        */
+/* section while it uses the text.  NULL if the register has no value.                */
+const char *IdiRegText(T_IdiReg *pReg, const char *const *ppEnumStrs, int enumCount)
+{
+    T_IdiRegText *pText = pReg->pText.load(std::memory_order_acquire);
+    uint32_t version = __atomic_load_n(&pReg->stamp.version, __ATOMIC_ACQUIRE);
+
+    if (pText && pText->version == version && pText->ppEnumStrs == ppEnumStrs) {
+        return pText->text;
+    }
+
+    T_IdiVal val;
+    T_IdiRegStamp stamp;
+    IdiRegLoadStamped(pReg, &val, &stamp);
+    if (val.type == IdiValNone) {
+        return NULL;
+    }
+    const char *pEnumStr = NULL;
+    if (val.type == IdiValEnum && ppEnumStrs && val.enumIdx >= 0 && val.enumIdx < enumCount) {
+        pEnumStr = ppEnumStrs[val.enumIdx];
+    }
+    T_IdiBuf *pBuf = IdiBufLocal();
+    if (IdiValWrite(&val, pEnumStr, pBuf) == NULL) {
+        return NULL;
+    }
+    T_IdiRegText *pNew = (T_IdiRegText *)malloc(offsetof(T_IdiRegText, text) + pBuf->len + 1);
+    if (pNew == NULL) {
+        err_printf("ERROR: %s- failed to allocate %zu bytes of register text\n", __FUNCTION__, pBuf->len);
+        return NULL;
+    }
+    pNew->version = stamp.version;
+    pNew->ppEnumStrs = ppEnumStrs;
+    pNew->len = pBuf->len;
+    memcpy(pNew->text, pBuf->pData, pBuf->len + 1);
+
+    // whoever printed last wins, a reader that still uses the text it replaces keeps it
+    // until it leaves its section
+    pText = pReg->pText.load(std::memory_order_relaxed);
+    while (!pReg->pText.compare_exchange_weak(pText, pNew, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+    }
+    if (pText) {
+        IdiEbrRetire(pText, free);
+    }
+
+    return pNew->text;
+}
+
+
+/* IdiRegFree: free the register's value and text; nobody may use the register any more */
+void IdiRegFree(T_IdiReg *pReg)
+{
+    IdiValClear(&pReg->val);
+    free(pReg->pText.exchange(NULL, std::memory_order_relaxed));
+}
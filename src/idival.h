@@ -0,0 +1,131 @@
+//
+// idival.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Register values held as tagged values: numbers, booleans, enum indexes and short
+// strings are kept inline, longer strings and structured (native) values out of
+// line.  Values are only turned into JSON text at the ETI and IDL edges, into a
+// growable buffer each thread reuses, so printing a value does not allocate once the
+// thread's buffer has grown; a copy is only made where the text changes hands.
+//
+// A register (T_IdiReg) guards its value with a sequence lock: writers serialize on
+// it, readers copy the value without blocking and retry if a writer got in between.
+// Storage a writer replaces out of line is retired through the epoch reclamation
+// (idiebr.h), so a reader may use what it copied until it leaves its section.  Each
+// register counts the changes of its value and notes when the device or a write
+// last changed it, so "changed since" needs no comparison of values.  It also keeps
+// the JSON text of its value, printed on first use after a change and shared by
+// every read and publish until the value changes again.
+//
+
+#ifndef IDIVAL_H
+#define IDIVAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+
+#include "cJSON.h"
+
+#define IDI_VAL_INLINE_STR      23      // longest string kept inline
+#define IDI_BUF_MIN_SIZE        256     // first size of a growing text buffer
+#define IDI_BUF_NUM_SIZE        32      // room a number's text may take
+
+typedef enum {
+    IdiValNone = 0,                     // no value
+    IdiValNull,                         // JSON null
+    IdiValDouble,
+    IdiValBool,
+    IdiValEnum,                         // index into the datapoint's enum map
+    IdiValString,                       // string of up to IDI_VAL_INLINE_STR chars in str
+    IdiValLongString,                   // longer string in pStr
+    IdiValJson                          // object or array, its JSON text in pJson
+} IdiValType;
+
+typedef struct _IdiVal {
+    uint8_t type;                       // IdiValType
+    union {
+        double d;
+        bool b;
+        int enumIdx;
+        char str[IDI_VAL_INLINE_STR + 1];
+        char *pStr;
+        char *pJson;
+    };
+} T_IdiVal;
+
+typedef struct _IdiBuf {
+    char *pData;                        // '\0' terminated text, NULL until first written
+    size_t len;                         // characters written
+    size_t size;                        // bytes allocated
+} T_IdiBuf;
+
+typedef struct _IdiRegStamp {
+    uint32_t version;                   // changes of the value so far, 0 while it never had one
+    uint64_t changedMs;                 // IdiNowMs of the last change by IdiRegStore, 0 if none
+} T_IdiRegStamp;
+
+typedef struct _IdiRegText {
+    uint32_t version;                   // stamp.version of the value it was printed from
+    const char *const *ppEnumStrs;      // enum strings it was printed with, NULL for none
+    size_t len;
+    char text[1];                       // len characters and the terminating '\0'
+} T_IdiRegText;
+
+typedef struct _IdiReg {
+    std::atomic<uint32_t> seq;          // odd while a writer changes val or stamp
+    T_IdiRegStamp stamp;
+    T_IdiVal val;
+    std::atomic<T_IdiRegText *> pText;  // text of val, stale once stamp.version moved on
+} T_IdiReg;
+
+
+extern void IdiValClear(T_IdiVal *pVal);
+extern void IdiValSetDouble(T_IdiVal *pVal, double d);
+extern void IdiValSetEnum(T_IdiVal *pVal, int enumIdx);
+extern void IdiValSetNull(T_IdiVal *pVal);
+extern int IdiValSetString(T_IdiVal *pVal, const char *pStr);
+extern int IdiValSetJson(T_IdiVal *pVal, const cJSON *pJson);
+extern int IdiValSetJsonText(T_IdiVal *pVal, const char *pText, size_t len);
+extern int IdiValParse(T_IdiVal *pVal, const char *pText);
+extern void IdiValMove(T_IdiVal *pDst, T_IdiVal *pSrc);
+extern bool IdiValEqual(const T_IdiVal *pVal1, const T_IdiVal *pVal2);
+extern const char *IdiValStr(const T_IdiVal *pVal);
+extern T_IdiBuf *IdiBufLocal(void);
+extern bool IdiBufPut(T_IdiBuf *pBuf, const char *pStr);
+extern bool IdiBufPutNumber(T_IdiBuf *pBuf, double d);
+extern const char *IdiValWrite(const T_IdiVal *pVal, const char *pEnumStr, T_IdiBuf *pBuf);
+
+extern void IdiRegLoad(const T_IdiReg *pReg, T_IdiVal *pVal);
+extern void IdiRegLoadStamped(const T_IdiReg *pReg, T_IdiVal *pVal, T_IdiRegStamp *pStamp);
+extern bool IdiRegChangedSince(const T_IdiReg *pReg, uint32_t version);
+extern bool IdiRegHasValue(const T_IdiReg *pReg);
+extern bool IdiRegStore(T_IdiReg *pReg, T_IdiVal *pVal);
+extern bool IdiRegStoreIfNone(T_IdiReg *pReg, T_IdiVal *pVal);
+extern void IdiRegClear(T_IdiReg *pReg);
+extern const char *IdiRegText(T_IdiReg *pReg, const char *const *ppEnumStrs, int enumCount);
+extern void IdiRegFree(T_IdiReg *pReg);
+
+#endif
@@ -0,0 +1,126 @@
+//
+// idixform.cpp
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Per datapoint value transforms compiled at datapoint creation
+//
+
+#include <strings.h>
+
+#include "common.h"
+#include "idixform.h"
+
+
+/* IdiXformStr: the double of a string value */
+static inline int IdiXformStr(const T_IdiXform *pXform, const char *pStr, double *pD)
+{
+    if (pXform->bInvalidStr && strcmp(pStr, INVALID_STR) == 0) {
+        return IDI_XFORM_INVALID;
+    }
+    if (pXform->kind != IdiXformEnum) {
+        return FAILURE;
+    }
+    int idx = IdiEnumIdxOfStr(pXform->pEnumTab, pStr);
+    *pD = ((idx >= 0) ? pXform->pEnumTab->pValues[idx] : pXform->unknownEnum) * pXform->multiplier;
+    return SUCCESS;
+}
+
+
+/* IdiXformReadNumber: read function of a number datapoint */
+static int IdiXformReadNumber(const T_IdiXform *pXform, const T_IdiVal *pVal, double *pD)
+{
+    if (pVal->type == IdiValDouble) {
+        *pD = pVal->d * pXform->multiplier;
+        return SUCCESS;
+    }
+    const char *pStr = IdiValStr(pVal);
+    return pStr ? IdiXformStr(pXform, pStr, pD) : FAILURE;
+}
+
+
+/* IdiXformReadEnum: read function of an enum datapoint, the number of an index */
+static int IdiXformReadEnum(const T_IdiXform *pXform, const T_IdiVal *pVal, double *pD)
+{
+    if (pVal->type == IdiValEnum) {
+        if (pVal->enumIdx < 0 || pVal->enumIdx >= pXform->pEnumTab->count) {
+            return FAILURE;
+        }
+        *pD = pXform->pEnumTab->pValues[pVal->enumIdx] * pXform->multiplier;
+        return SUCCESS;
+    }
+    return IdiXformReadNumber(pXform, pVal, pD);
+}
+
+
+/* IdiXformWriteNumber: write function of a number datapoint */
+static void IdiXformWriteNumber(const T_IdiXform *pXform, double d, T_IdiVal *pVal)
+{
+    IdiValSetDouble(pVal, d);
+}
+
+
+/* IdiXformWriteEnum: write function of an enum datapoint, null for a value not in the enum map */
+static void IdiXformWriteEnum(const T_IdiXform *pXform, double d, T_IdiVal *pVal)
+{
+    int idx = IdiEnumIdxOfValue(pXform->pEnumTab, d);
+
+    if (idx >= 0) {
+        IdiValSetEnum(pVal, idx);
+    } else {
+        IdiValSetNull(pVal);
+    }
+}
+
+
+/* IdiXformCompile: set up the transform of a datapoint.  pEnumTab is the table of its  */
+/* enum map, NULL if it has none.  bInvalidStr if the "invalid" string stands for its   */
+/* invalid value, unknownEnum is read for an enum string not in the map and multiplier */
+/* is applied to what is read, 0 is taken as 1.                                         */
+void IdiXformCompile(T_IdiXform *pXform, const T_IdiEnumTab *pEnumTab, bool bInvalidStr, 
+                     double unknownEnum, double multiplier)
+{
+    pXform->kind = pEnumTab ? IdiXformEnum : IdiXformNumber;
+    pXform->pfnRead = pEnumTab ? IdiXformReadEnum : IdiXformReadNumber;
+    pXform->pfnWrite = pEnumTab ? IdiXformWriteEnum : IdiXformWriteNumber;
+    pXform->bInvalidStr = bInvalidStr;
+    pXform->multiplier = (multiplier != 0) ? multiplier : 1;
+    pXform->unknownEnum = unknownEnum;
+    pXform->pEnumTab = pEnumTab;
+}
+
+
+/* IdiXformRead: the double of a register value, SUCCESS, FAILURE if it has none or */
+/* IDI_XFORM_INVALID for the "invalid" string                                     */
+int IdiXformRead(const T_IdiXform *pXform, const T_IdiVal *pVal, double *pD)
+{
+    return pXform->pfnRead(pXform, pVal, pD);
+}
+
+
+/* IdiXformWrite: the register value of a double */
+void IdiXformWrite(const T_IdiXform *pXform, double d, T_IdiVal *pVal)
+{
+    pXform->pfnWrite(pXform, d, pVal);
+}
+
@@ -0,0 +1,70 @@
+//
+// idixform.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+//
+// Per datapoint value transforms.  What a datapoint's double means in its register
+// value, an enum value kept as the index of its enum string or a plain number, the
+// "invalid" string and the XIF TestMultiplier are settled once when the datapoint is
+// created.  The result is one read and one write function and their constants,
+// applied without looking at the datapoint's flags again.  The scaling of the IAP
+// type (ScalingObject) is applied by the Idl library to the double, not here.
+//
+
+#ifndef IDIXFORM_H
+#define IDIXFORM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "idival.h"
+#include "idienum.h"
+
+#define IDI_XFORM_INVALID       2       // IdiXformRead: the value is the "invalid" string
+
+typedef enum {
+    IdiXformNumber = 0,                 // the register holds the number
+    IdiXformEnum,                       // the register holds the index of the enum string
+} IdiXformKind;
+
+typedef struct _IdiXform T_IdiXform;
+typedef int (*T_IdiXformReadFn)(const T_IdiXform *pXform, const T_IdiVal *pVal, double *pD);
+typedef void (*T_IdiXformWriteFn)(const T_IdiXform *pXform, double d, T_IdiVal *pVal);
+
+struct _IdiXform {
+    T_IdiXformReadFn pfnRead;           // register value to double
+    T_IdiXformWriteFn pfnWrite;         // double to register value
+    uint8_t kind;                       // IdiXformKind
+    bool bInvalidStr;                   // the "invalid" string stands for the invalid value
+    double multiplier;                  // applied to what is read, 1 for none
+    double unknownEnum;                 // read for an enum string not in the enum map
+    const T_IdiEnumTab *pEnumTab;       // lookups in the enum map, NULL if there is none
+};
+
+
+extern void IdiXformCompile(T_IdiXform *pXform, const T_IdiEnumTab *pEnumTab, bool bInvalidStr, 
+                            double unknownEnum, double multiplier);
+extern int IdiXformRead(const T_IdiXform *pXform, const T_IdiVal *pVal, double *pD);
+extern void IdiXformWrite(const T_IdiXform *pXform, double d, T_IdiVal *pVal);
+
+#endif
@@ -50,11 +50,31 @@ void myDbgBreak(void) {
 #endif
 
 
+/* SigWaitThrdFunc: stop the driver cleanly on SIGTERM or SIGINT */
+static void *SigWaitThrdFunc(void *pvArg)
+{
+    sigset_t *pSigSet = (sigset_t *)pvArg;
+    int sig = 0;
+
+    pthread_setname_np(pthread_self(), "SigWait");
+    if (sigwait(pSigSet, &sig) == 0) {
+        printf("The " CDNAME " IDL Driver stopping on signal %d...\r\n", sig);
+        // the IDL and ETI threads still run: exit() would tear down what they use
+        IdiShutdown();
+        fflush(stdout);
+        _exit(0);
+    }
+    return NULL;
+}
+
+
 /* main: Main entry point for this custom driver example */
 int main(int argc, char **argv)
 {
     char conf_path[256] ="/var/apollo/data/" CDNAME "/" CDNAME "-idl.conf";
     pthread_t IdiProcessAsynchThread;
+    pthread_t SigWaitThread;
+    static sigset_t sigSet;
 
 /* code section for inserting a countdown wait for the debugger to attach */
 #ifdef WAIT_FOR_DEBUGGER_ATTACH
@@ -87,6 +107,16 @@ int main(int argc, char **argv)
 
 #endif
 
+    /* SIGTERM and SIGINT are taken by a thread of their own, which stops */
+    /* the driver through IdiShutdown.  Every thread created from here on */
+    /* inherits the blocked signals, those of the IDL and IdiStart() too. */
+    atexit(IdiShutdown);
+    sigemptyset(&sigSet);
+    sigaddset(&sigSet, SIGTERM);
+    sigaddset(&sigSet, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+    pthread_create(&SigWaitThread, NULL, SigWaitThrdFunc, &sigSet);
+
     Idl *idl = IdlNew();		// Create a new driver instance
 
     /* Register the CDNAME Driver Callback Routines with the IAP Driver Library (IDL) */
@@ -108,7 +138,7 @@ int main(int argc, char **argv)
     IdlDpUnrecColumnCallbackSet(idl, OnUnrecColumnCb);
     #endif
 
-    if (IdiStart() == 0) {
+    if (IdiStart(conf_path) == 0) {
         printf("The " CDNAME " IDL Driver started up...\r\n");
 		
 		/* Create any POSIX threads your driver might need before calling  */
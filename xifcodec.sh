@@ -0,0 +1,182 @@
+#!/bin/bash
+#
+# Generate idixif.h, the register map and the codecs of the datapoints in the driver's
+# XIF files (see src/idicodec.h)
+#
+#   xifcodec.sh <idixif.h to write> [<XIF file> ...]
+#
+
+# IAP types whose value is an object of number fields, the fields in print order
+OBJECT_TYPES="SNVT_switch:value,state
+SNVT_temp_setpt:occupied_cool,standby_cool,unoccupied_cool,occupied_heat,standby_heat,unoccupied_heat"
+# IAP types whose value is a number
+NUMBER_TYPES="SNVT_count SNVT_count_f SNVT_count_inc SNVT_count_inc_f SNVT_temp SNVT_temp_p SNVT_temp_f
+SNVT_lux SNVT_volt SNVT_volt_f SNVT_amp SNVT_amp_f SNVT_power SNVT_power_f SNVT_power_kilo SNVT_elec_kwh
+SNVT_flow SNVT_flow_f SNVT_press SNVT_press_p SNVT_press_f SNVT_lev_percent SNVT_lev_cont SNVT_rpm"
+# native types that are numbers
+NUMBER_NATIVES="UINT8 UINT16 UINT32 INT8 INT16 INT32 SINT8 SINT16 SINT32 FLOAT FLOAT32 FLOAT64 DOUBLE"
+
+set -o pipefail
+
+OUT=$1
+shift
+if [ -z "$OUT" ]; then
+    echo "usage: $0 <idixif.h> [<XIF file> ...]" >&2
+    exit 1
+fi
+mkdir -p "$(dirname "$OUT")"
+
+# one tab separated line per datapoint row: program ID, name, IAP type, IAP field, native type,
+# writable, address.  Without XIF files the header has an empty map, /dev/null keeps awk
+# from reading stdin then.
+ROWS=$(awk -F, '
+    FNR == 1 { cols = 0; pid = "" }
+    { sub(/\r$/, "") }
+    /^#program_ID,/ { pid = $2 }
+    /^#/ || /^[ \t]*$/ { next }
+    cols == 0 {
+        for (i = 1; i <= NF; i++) {
+            col[$i] = i
+        }
+        cols = NF
+        if (!("Datapoint Name" in col) || !("IAP Type" in col) || !("Address" in col)) {
+            printf("%s: no Datapoint Name, IAP Type and Address columns\n", FILENAME) > "/dev/stderr"
+            exit 1
+        }
+        next
+    }
+    {
+        name = $col["Datapoint Name"]
+        type = $col["IAP Type"]
+        field = ("IAP Field" in col) ? $col["IAP Field"] : ""
+        native = ("Native type" in col) ? $col["Native type"] : ""
+        wr = ("Write Enable" in col) ? $col["Write Enable"] : ""
+        # datapoint names are only unique within the XIF of one program ID
+        if ((pid, name) in seen) {
+            printf("%s: %s is listed twice for program ID %s, the first one is kept\n", FILENAME, name, pid) > "/dev/stderr"
+            next
+        }
+        seen[pid, name] = 1
+        printf("%s\t%s\t%s\t%s\t%s\t%s\t%d\n", pid, name, type, field, native, (wr == "+") ? "true" : "false", $col["Address"])
+    }' "$@" /dev/null | LC_ALL=C sort -t "$(printf '\t')" -k1,1 -k2,2) || exit 1
+
+printf '%s\n' "$ROWS" | LC_ALL=C awk -F '\t' -v objects="$OBJECT_TYPES" -v numbers="$NUMBER_TYPES" \
+        -v natives="$NUMBER_NATIVES" -v sources="$(for f in "$@"; do basename "$f"; done | tr '\n' ' ' | sed 's/ $//')" '
+    function cstr(s) {
+        gsub(/\\/, "\\\\", s)
+        gsub(/"/, "\\\"", s)
+        return "\"" s "\""
+    }
+    function ident(s) {
+        gsub(/[^A-Za-z0-9_]/, "_", s)
+        return s
+    }
+    # the codec kind of a row, "" for none
+    function kindOf(type, field, native) {
+        if (field != "") {
+            return (type in fields || native in isNative) ? "IdiCodecNumber" : ""
+        }
+        if (type in fields && (native == "" || native == type)) {
+            return "IdiCodecObject"
+        }
+        if (type in isNumber || native in isNative) {
+            return "IdiCodecNumber"
+        }
+        return ""
+    }
+    # the codec is looked up by IAP type and field, rows that disagree on its kind get none
+    function codecOf(type, field, native,    kind, key) {
+        kind = kindOf(type, field, native)
+        key = type SUBSEP field
+        if (!(key in codecKey)) {
+            codecKey[key] = kind
+            keyType[key] = type
+            keyField[key] = field
+        } else if (codecKey[key] != kind && codecKey[key] != "none") {
+            printf("%s.%s is mapped with different native types, its values go through cJSON\n", type, field) > "/dev/stderr"
+            codecKey[key] = "none"
+        }
+        return key
+    }
+    BEGIN {
+        n = split(objects, list, "\n")
+        for (i = 1; i <= n; i++) {
+            split(list[i], part, ":")
+            fields[part[1]] = part[2]
+        }
+        n = split(numbers, list, /[ \n]+/)
+        for (i = 1; i <= n; i++) {
+            isNumber[list[i]] = 1
+        }
+        n = split(natives, list, /[ \n]+/)
+        for (i = 1; i <= n; i++) {
+            isNative[list[i]] = 1
+        }
+        rowCount = 0
+    }
+    NF >= 7 {
+        row[rowCount] = sprintf("{%s, %s, %s, %s, %s, %s, %d, ", cstr($1), cstr($2), cstr($3), cstr($4), cstr($5), $6, $7)
+        rowCodec[rowCount] = codecOf($3, $4, $5)
+        rowCount++
+    }
+    END {
+        # the codecs with a kind, sorted by IAP type and field for IdiCodecOf
+        codecCount = 0
+        for (key in codecKey) {
+            if (codecKey[key] == "" || codecKey[key] == "none") {
+                continue
+            }
+            for (c = codecCount; c > 0; c--) {
+                prev = keyType[sorted[c - 1]]
+                if (prev < keyType[key] || (prev == keyType[key] && keyField[sorted[c - 1]] < keyField[key])) {
+                    break
+                }
+                sorted[c] = sorted[c - 1]
+            }
+            sorted[c] = key
+            codecCount++
+        }
+        for (c = 0; c < codecCount; c++) {
+            codecIdx[sorted[c]] = c
+            codecType[c] = keyType[sorted[c]]
+            codecField[c] = keyField[sorted[c]]
+            codecKind[c] = codecKey[sorted[c]]
+        }
+        printf("//\n// idixif.h\n//\n// Generated by xifcodec.sh from %s, do not edit\n//\n\n", (sources != "") ? sources : "no XIF files")
+        printf("#ifndef IDIXIF_H\n#define IDIXIF_H\n\n")
+        printf("#define IDI_XIF_REG_COUNT       %d\n", rowCount)
+        printf("#define IDI_XIF_CODEC_COUNT     %d\n", codecCount)
+        if (rowCount > 0) {
+            printf("\n")
+            for (c = 0; c < codecCount; c++) {
+                if (codecKind[c] == "IdiCodecObject" && !(codecType[c] in printed)) {
+                    printed[codecType[c]] = 1
+                    n = split(fields[codecType[c]], list, ",")
+                    printf("static constexpr const char *gIdiXifFields_%s[] = {", ident(codecType[c]))
+                    for (i = 1; i <= n; i++) {
+                        printf("%s%s", (i > 1) ? ", " : "", cstr(list[i]))
+                    }
+                    printf("};\n")
+                }
+            }
+            if (codecCount > 0) {
+                printf("\nstatic constexpr T_IdiCodec gIdiXifCodecs[] = {\n")
+                for (c = 0; c < codecCount; c++) {
+                    if (codecKind[c] == "IdiCodecObject") {
+                        printf("    {%s, %s, %s, %d, gIdiXifFields_%s},\n", cstr(codecType[c]), cstr(codecField[c]),
+                               codecKind[c], split(fields[codecType[c]], list, ","), ident(codecType[c]))
+                    } else {
+                        printf("    {%s, %s, %s, 0, NULL},\n", cstr(codecType[c]), cstr(codecField[c]), codecKind[c])
+                    }
+                }
+                printf("};\n")
+            }
+            printf("\n// program ID, name, IAP type, IAP field, native type, writable, address, codec\n")
+            printf("static constexpr T_IdiXifReg gIdiXifRegs[] = {\n")
+            for (r = 0; r < rowCount; r++) {
+                printf("    %s%s},\n", row[r], (rowCodec[r] in codecIdx) ? "&gIdiXifCodecs[" codecIdx[rowCodec[r]] "]" : "NULL")
+            }
+            printf("};\n")
+        }
+        printf("\n#endif\n")
+    }' > "$OUT.tmp" && mv -f "$OUT.tmp" "$OUT"